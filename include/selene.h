@@ -1,4 +1,6 @@
 #pragma once
 
+#include "selene/EventLoop.h"
 #include "selene/State.h"
+#include "selene/StatePool.h"
 #include "selene/Tuple.h"
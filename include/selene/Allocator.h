@@ -0,0 +1,252 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+#include <vector>
+
+extern "C" {
+#include <lua.h>
+}
+
+namespace sel {
+/*
+ * Allocator policies passed to State have a single member with the
+ * semantics of lua_Alloc:
+ *
+ *     void *Allocate(void *ptr, std::size_t osize, std::size_t nsize);
+ *
+ * A zero nsize frees ptr and returns nullptr. Otherwise the block is
+ * (re)allocated to nsize bytes, or nullptr is returned on failure.
+ * When ptr is nullptr, osize is not a size and must be ignored.
+ */
+
+// Forwards to the C allocator, as luaL_newstate does
+class DefaultAllocator {
+public:
+    void *Allocate(void *ptr, std::size_t, std::size_t nsize) {
+        if (nsize == 0) {
+            std::free(ptr);
+            return nullptr;
+        }
+        return std::realloc(ptr, nsize);
+    }
+};
+
+/*
+ * Serves blocks of up to _max_size bytes from free lists, one per
+ * multiple of _granularity, carved out of large chunks. Larger blocks
+ * go to the C allocator. Memory of the small blocks is returned to the
+ * system only when the allocator is destroyed, and no locking is done:
+ * use one pool per State.
+ */
+class PoolAllocator {
+private:
+    static constexpr std::size_t _granularity = 16;
+    static constexpr std::size_t _max_size = 256;
+    static constexpr std::size_t _num_classes = _max_size / _granularity;
+    static constexpr std::size_t _chunk_size = 64 * 1024;
+
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+
+    FreeBlock *_free[_num_classes];
+    std::vector<void *> _chunks;
+    char *_cursor;
+    char *_end;
+    // Blocks Lua believes have another size class, with their actual
+    // size. Lua expects shrinking not to fail, so a shrink that finds
+    // no block of the new class keeps the old one.
+    std::vector<std::pair<void *, std::size_t>> _kept;
+
+    static std::size_t _class_of(std::size_t size) {
+        return (size - 1) / _granularity;
+    }
+
+    // _num_classes for the blocks of the C allocator
+    static std::size_t _kind_of(std::size_t size) {
+        return size <= _max_size ? _class_of(size) : _num_classes;
+    }
+
+    // Records that ptr is believed to have size bytes
+    void _keep(void *ptr, std::size_t actual, std::size_t size) {
+        if (_kind_of(actual) == _kind_of(size)) return;
+        try {
+            _kept.emplace_back(ptr, actual);
+        } catch (const std::bad_alloc &) {
+            // The block is then reused for its believed class, which
+            // is smaller, and a block of the C allocator is leaked
+        }
+    }
+
+    // The actual size of ptr, which Lua believes has size bytes
+    std::size_t _forget(void *ptr, std::size_t size) {
+        for (auto &kept : _kept) {
+            if (kept.first == ptr) {
+                size = kept.second;
+                kept = _kept.back();
+                _kept.pop_back();
+                break;
+            }
+        }
+        return size;
+    }
+
+    void *_pop(std::size_t size) {
+        const std::size_t c = _class_of(size);
+        FreeBlock *block = _free[c];
+        if (block != nullptr) {
+            _free[c] = block->next;
+            return block;
+        }
+        const std::size_t block_size = (c + 1) * _granularity;
+        if (std::size_t(_end - _cursor) < block_size) {
+            void *chunk = std::malloc(_chunk_size);
+            if (chunk == nullptr) return nullptr;
+            _chunks.push_back(chunk);
+            _cursor = static_cast<char *>(chunk);
+            _end = _cursor + _chunk_size;
+        }
+        void *ret = _cursor;
+        _cursor += block_size;
+        return ret;
+    }
+
+    void _push(void *ptr, std::size_t size) {
+        const std::size_t c = _class_of(size);
+        FreeBlock *block = static_cast<FreeBlock *>(ptr);
+        block->next = _free[c];
+        _free[c] = block;
+    }
+
+public:
+    PoolAllocator() : _cursor(nullptr), _end(nullptr) {
+        for (std::size_t i = 0; i < _num_classes; ++i) {
+            _free[i] = nullptr;
+        }
+        _kept.reserve(8);
+    }
+    PoolAllocator(const PoolAllocator &) = delete;
+    PoolAllocator &operator=(const PoolAllocator &) = delete;
+    ~PoolAllocator() {
+        for (auto &kept : _kept) {
+            if (kept.second > _max_size) std::free(kept.first);
+        }
+        for (void *chunk : _chunks) {
+            std::free(chunk);
+        }
+    }
+
+    void *Allocate(void *ptr, std::size_t osize, std::size_t nsize) {
+        if (ptr == nullptr) osize = 0;
+        const std::size_t actual =
+            _kept.empty() || ptr == nullptr ? osize : _forget(ptr, osize);
+        const bool old_small = actual > 0 && actual <= _max_size;
+        const bool new_small = nsize > 0 && nsize <= _max_size;
+        if (nsize == 0) {
+            if (old_small) {
+                _push(ptr, actual);
+            } else {
+                std::free(ptr);
+            }
+            return nullptr;
+        }
+        if (!old_small && !new_small) {
+            void *ret = std::realloc(ptr, nsize);
+            return ret != nullptr || nsize > osize ? ret : ptr;
+        }
+        if (old_small && new_small && _class_of(actual) == _class_of(nsize)) {
+            return ptr;
+        }
+        void *ret = new_small ? _pop(nsize) : std::malloc(nsize);
+        if (ret == nullptr) {
+            if (ptr == nullptr) return nullptr;
+            if (nsize > osize) {
+                _keep(ptr, actual, osize);
+                return nullptr;
+            }
+            _keep(ptr, actual, nsize);
+            return ptr;
+        }
+        if (ptr != nullptr) {
+            std::memcpy(ret, ptr, osize < nsize ? osize : nsize);
+            if (old_small) {
+                _push(ptr, actual);
+            } else {
+                std::free(ptr);
+            }
+        }
+        return ret;
+    }
+};
+
+// Memory use of a State, see State::MemoryStats()
+struct MemoryStats {
+    // Bytes currently allocated
+    std::size_t live;
+    // Highest value live has reached
+    std::size_t peak;
+    // Number of blocks allocated, not counting resizes
+    std::size_t allocations;
+    // Number of allocations refused because of the limit
+    std::size_t failures;
+    // Maximum of live bytes, 0 for no limit
+    std::size_t limit;
+};
+
+/*
+ * Keeps MemoryStats for the blocks it passes on to Inner and refuses
+ * to grow past the limit. Lua reports a refused allocation as a
+ * memory error to the code that caused it, and the state stays
+ * usable.
+ */
+template <typename Inner = DefaultAllocator>
+class AccountingAllocator {
+private:
+    Inner _inner;
+    MemoryStats _stats;
+
+public:
+    AccountingAllocator(std::size_t limit = 0) : _stats{0, 0, 0, 0, limit} {}
+
+    MemoryStats &Stats() {
+        return _stats;
+    }
+
+    void *Allocate(void *ptr, std::size_t osize, std::size_t nsize) {
+        if (ptr == nullptr) osize = 0;
+        if (nsize > osize && _stats.limit != 0 &&
+            _stats.live + (nsize - osize) > _stats.limit) {
+            ++_stats.failures;
+            return nullptr;
+        }
+        void *ret = _inner.Allocate(ptr, osize, nsize);
+        if (ret == nullptr && nsize != 0) return nullptr;
+        _stats.live = _stats.live - osize + nsize;
+        if (_stats.live > _stats.peak) _stats.peak = _stats.live;
+        if (ptr == nullptr) ++_stats.allocations;
+        return ret;
+    }
+};
+
+namespace detail {
+// Allocators other than AccountingAllocator keep no statistics
+template <typename Allocator>
+MemoryStats *_memory_stats(Allocator *) {
+    return nullptr;
+}
+
+template <typename Inner>
+MemoryStats *_memory_stats(AccountingAllocator<Inner> *allocator) {
+    return &allocator->Stats();
+}
+
+template <typename Allocator>
+void *_lua_alloc(void *ud, void *ptr, std::size_t osize, std::size_t nsize) {
+    return static_cast<Allocator *>(ud)->Allocate(ptr, osize, nsize);
+}
+}
+}
@@ -1,20 +1,60 @@
 #pragma once
 
+#include "Budget.h"
 #include "exotics.h"
 #include <functional>
 #include <tuple>
 
+#ifdef SELENE_BINDING_STATS
+#include "BindingStats.h"
+#include <chrono>
+#endif
+
 namespace sel {
 struct BaseFun {
     virtual ~BaseFun() {}
     virtual int Apply(lua_State *state) = 0;
+#ifdef SELENE_BINDING_STATS
+    // Set by Registry::Track for bindings with a name
+    BindingStats *stats = nullptr;
+#endif
 };
 
 namespace detail {
 
+// Values Apply may return instead of a number of results. Yielding
+// and raising errors are left to _lua_dispatcher so that no C++ frame
+// is skipped by Lua's longjmp.
+constexpr int _yield = -1;
+constexpr int _raise_error = -2;
+
 inline int _lua_dispatcher(lua_State *l) {
     BaseFun *fun = (BaseFun *)lua_touserdata(l, lua_upvalueindex(1));
-    return fun->Apply(l);
+    int n = 0;
+    // A call the binding made into Lua ran out of budget
+    BudgetLimit overrun = BudgetLimit::None;
+    try {
+#ifdef SELENE_BINDING_STATS
+        if (fun->stats != nullptr) {
+            using clock = std::chrono::steady_clock;
+            const auto start = clock::now();
+            n = fun->Apply(l);
+            fun->stats->Record(clock::now() - start);
+        } else {
+            n = fun->Apply(l);
+        }
+#else
+        n = fun->Apply(l);
+#endif
+    } catch (const BudgetExceeded &e) {
+        overrun = e.Limit();
+    }
+    if (overrun != BudgetLimit::None) {
+        return luaL_error(l, "%s", _budget_message(overrun));
+    }
+    if (n == _yield) return lua_yield(l, 0);
+    if (n == _raise_error) return lua_error(l);
+    return n;
 }
 
 template <typename Ret, typename... Args, std::size_t... N>
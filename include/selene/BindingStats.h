@@ -0,0 +1,64 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+namespace sel {
+/*
+ * Calls of a C++ function bound to Lua and the time spent in them,
+ * recorded by _lua_dispatcher when Selene is built with
+ * SELENE_BINDING_STATS defined. The time covers converting the
+ * arguments, the call itself and pushing the results. Calls raising a
+ * Lua error are not recorded.
+ */
+struct BindingStats {
+    // histogram[i] counts the calls that took less than 2^(i+1) ns,
+    // and at least 2^i ns for i > 0. The last bucket takes the rest.
+    static constexpr int Buckets = 32;
+
+    std::uint64_t calls = 0;
+    std::chrono::nanoseconds total{0};
+    std::array<std::uint64_t, Buckets> histogram{};
+
+    void Record(std::chrono::nanoseconds elapsed) {
+        ++calls;
+        total += elapsed;
+        std::uint64_t ns = elapsed.count() > 0 ? elapsed.count() : 0;
+        int bucket = 0;
+        while (ns > 1 && bucket < Buckets - 1) {
+            ns >>= 1;
+            ++bucket;
+        }
+        ++histogram[bucket];
+    }
+
+    std::chrono::nanoseconds Mean() const {
+        return calls == 0 ? std::chrono::nanoseconds(0)
+            : total / std::int64_t(calls);
+    }
+
+    // Upper bound of the bucket holding the q-th quantile, 0 < q <= 1
+    std::chrono::nanoseconds Quantile(double q) const {
+        const double rank = q * calls;
+        std::uint64_t seen = 0;
+        for (int i = 0; i < Buckets; ++i) {
+            seen += histogram[i];
+            if (seen > 0 && seen >= rank) {
+                return std::chrono::nanoseconds(std::int64_t(2) << i);
+            }
+        }
+        return std::chrono::nanoseconds(0);
+    }
+};
+
+inline std::ostream &operator<<(std::ostream &os, const BindingStats &stats) {
+    os << stats.calls << " calls, "
+       << stats.total.count() / 1000 << " us total, "
+       << stats.Mean().count() << " ns mean, p50 < "
+       << stats.Quantile(0.5).count() << " ns, p99 < "
+       << stats.Quantile(0.99).count() << " ns";
+    return os;
+}
+}
@@ -0,0 +1,278 @@
+#pragma once
+
+#include "Budget.h"
+#include "CFunction.h"
+#include <cstdint>
+#include "exotics.h"
+#include "LuaRef.h"
+#include <string>
+#include "util.h"
+
+namespace sel {
+class Selector;
+class Table;
+
+/*
+ * A Selector whose path has already been resolved. The table owning
+ * the element is held in the registry so each access costs a single
+ * lookup instead of a walk from the globals table. Obtain one via
+ * Selector::Pin() or Table::operator[].
+ */
+class BoundSelector {
+    friend class Selector;
+    friend class Table;
+private:
+    lua_State *_state;
+    LuaRef _parent;
+    std::string _field;
+    int _index;
+    bool _is_index;
+    // Registry slot of the interned field name, or LUA_NOREF
+    int _key;
+    // Bypasses metamethods when set
+    bool _raw;
+
+    BoundSelector(lua_State *s, LuaRef parent, const char *field,
+                  bool raw = false, int key = LUA_NOREF)
+        : _state(s), _parent(parent), _field(field), _index(0),
+          _is_index(false), _key(key), _raw(raw) {}
+
+    BoundSelector(lua_State *s, LuaRef parent, int index, bool raw = false)
+        : _state(s), _parent(parent), _index(index), _is_index(true),
+          _key(LUA_NOREF), _raw(raw) {}
+
+    // Pushes the field name
+    void _push_field() const {
+        if (_key != LUA_NOREF) {
+            lua_rawgeti(_state, LUA_REGISTRYINDEX, _key);
+        } else {
+            lua_pushlstring(_state, _field.data(), _field.size());
+        }
+    }
+
+    // Pushes this element to the stack
+    void _get() const {
+        _parent.Push(_state);
+        if (_raw) {
+            // The parent of an invalid Table is nil
+            if (!lua_istable(_state, -1)) {
+                lua_pushnil(_state);
+            } else if (_is_index) {
+                lua_rawgeti(_state, -1, _index);
+            } else {
+                _push_field();
+                lua_rawget(_state, -2);
+            }
+        } else if (_is_index) {
+            lua_pushinteger(_state, _index);
+            lua_gettable(_state, -2);
+        } else if (_key != LUA_NOREF) {
+            _push_field();
+            lua_gettable(_state, -2);
+        } else {
+            lua_getfield(_state, -1, _field.c_str());
+        }
+        lua_remove(_state, -2);
+    }
+
+    // Sets this element to the value on top of the stack and pops it
+    void _put() const {
+        _parent.Push(_state);
+        if (_raw) {
+            lua_pushvalue(_state, -2);
+            if (!lua_istable(_state, -2)) {
+                lua_pop(_state, 1);
+            } else if (_is_index) {
+                lua_rawseti(_state, -2, _index);
+            } else {
+                _push_field();
+                lua_insert(_state, -2);
+                lua_rawset(_state, -3);
+            }
+        } else if (_is_index || _key != LUA_NOREF) {
+            if (_is_index) {
+                lua_pushinteger(_state, _index);
+            } else {
+                _push_field();
+            }
+            lua_pushvalue(_state, -3);
+            lua_settable(_state, -3);
+        } else {
+            lua_pushvalue(_state, -2);
+            lua_setfield(_state, -2, _field.c_str());
+        }
+        lua_pop(_state, 2);
+    }
+
+    template <typename T>
+    T _read() const {
+        _get();
+        return detail::_pop(detail::_id<T>{}, _state);
+    }
+
+    template <typename T>
+    void _write(T &&value) const {
+        detail::_push(_state, std::forward<T>(value));
+        _put();
+    }
+
+public:
+    bool operator==(BoundSelector &other) = delete;
+
+    // Same as Selector::Call
+    template <typename... Ret, typename... Args>
+    typename detail::_pop_n_impl<sizeof...(Ret), Ret...>::type
+    Call(Args&&... args) const {
+        detail::ResetStackOnScopeExit save(_state);
+        _get();
+        detail::_push_refs(_state, args...);
+        detail::BudgetScope budget(_state);
+        budget.Call(sizeof...(Args), sizeof...(Ret));
+        return detail::_pop_n<Ret...>(_state);
+    }
+
+    void operator=(bool b) const {
+        _write(b);
+    }
+
+    void operator=(int i) const {
+        _write(i);
+    }
+
+    void operator=(unsigned int i) const {
+        _write(i);
+    }
+
+    void operator=(std::int64_t i) const {
+        _write(i);
+    }
+
+    void operator=(std::uint64_t i) const {
+        _write(i);
+    }
+
+    void operator=(lua_Number n) const {
+        _write(n);
+    }
+
+    void operator=(const std::string &s) const {
+        _write(s);
+    }
+
+    void operator=(const char *s) const {
+        _write(std::string{s});
+    }
+
+    void operator=(CFunction fun) const {
+        _write(fun);
+    }
+
+    template <typename T>
+    operator T&() const {
+        return *_read<T*>();
+    }
+
+    template <typename T>
+    operator T*() const {
+        return _read<T*>();
+    }
+
+    operator bool() const {
+        return _read<bool>();
+    }
+
+    operator int() const {
+        return _read<int>();
+    }
+
+    operator unsigned int() const {
+        return _read<unsigned int>();
+    }
+
+    operator std::int64_t() const {
+        return _read<std::int64_t>();
+    }
+
+    operator std::uint64_t() const {
+        return _read<std::uint64_t>();
+    }
+
+    operator lua_Number() const {
+        return _read<lua_Number>();
+    }
+
+    operator std::string() const {
+        return _read<std::string>();
+    }
+
+    template <typename T>
+    void operator=(const std::vector<T> &values) const {
+        _write(values);
+    }
+
+    template <typename T, std::size_t N>
+    void operator=(const std::array<T, N> &values) const {
+        _write(values);
+    }
+
+    template <typename K, typename V>
+    void operator=(const std::map<K, V> &values) const {
+        _write(values);
+    }
+
+    template <typename K, typename V>
+    void operator=(const std::unordered_map<K, V> &values) const {
+        _write(values);
+    }
+
+    template <typename T>
+    operator std::vector<T>() const {
+        return _read<std::vector<T>>();
+    }
+
+    template <typename T, std::size_t N>
+    operator std::array<T, N>() const {
+        return _read<std::array<T, N>>();
+    }
+
+    template <typename K, typename V>
+    operator std::map<K, V>() const {
+        return _read<std::map<K, V>>();
+    }
+
+    template <typename K, typename V>
+    operator std::unordered_map<K, V>() const {
+        return _read<std::unordered_map<K, V>>();
+    }
+
+    // Defined in Table.h
+    operator Table() const;
+
+    template <typename R, typename... Args>
+    operator sel::function<R(Args...)>() const {
+        return _read<sel::function<R(Args...)>>();
+    }
+
+    friend bool operator==(const BoundSelector &, const char *);
+
+    friend bool operator==(const char *, const BoundSelector &);
+};
+
+inline bool operator==(const BoundSelector &s, const char *c) {
+    return std::string{c} == s._read<std::string>();
+}
+
+inline bool operator==(const char *c, const BoundSelector &s) {
+    return std::string{c} == s._read<std::string>();
+}
+
+template <typename T>
+inline bool operator==(const BoundSelector &s, T&& t) {
+    return T(s) == t;
+}
+
+template <typename T>
+inline bool operator==(T &&t, const BoundSelector &s) {
+    return T(s) == t;
+}
+}
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include "Hook.h"
+#include <stdexcept>
+#include <string>
+
+namespace sel {
+// Why a call was aborted
+enum class BudgetLimit {
+    None,
+    Instructions,
+    Time
+};
+
+/*
+ * Limits of a call from C++ into Lua: the VM instructions it may
+ * execute and the wall-clock time it may take, measured with a
+ * monotonic clock. 0 means no limit. Both are checked every
+ * CountHook::Period instructions, so a call may overrun them by that
+ * much, and time spent in a C or C++ function is only noticed once it
+ * returns to Lua.
+ */
+struct Budget {
+    std::size_t instructions;
+    std::chrono::microseconds time;
+
+    Budget(std::size_t instructions = 0,
+           std::chrono::microseconds time = std::chrono::microseconds(0))
+        : instructions(instructions), time(time) {}
+
+    bool Unlimited() const {
+        return instructions == 0 && time.count() == 0;
+    }
+};
+
+// Thrown by calls that return values (Selector, sel::function,
+// Chunk::Call) when they run out of budget. Calls returning a bool
+// return false instead, as do calls deferred with Selector::operator()
+// whose results are not read; see State::LastOverrun.
+class BudgetExceeded : public std::runtime_error {
+private:
+    BudgetLimit _limit;
+
+public:
+    BudgetExceeded(BudgetLimit limit, const std::string &message)
+        : std::runtime_error(message), _limit(limit) {}
+
+    BudgetLimit Limit() const {
+        return _limit;
+    }
+};
+
+namespace detail {
+inline const char *_budget_message(BudgetLimit limit) {
+    return limit == BudgetLimit::Instructions
+        ? "instruction budget exceeded" : "time budget exceeded";
+}
+
+/*
+ * Enforces the budget of a state from its count hook. Only the
+ * outermost call from C++ into Lua is budgeted; calls nested in it
+ * through bound C++ functions share its budget. Once the budget is
+ * spent, the hook raises an error after every instruction, so Lua code
+ * catching it with pcall cannot keep running.
+ *
+ * While a budgeted call runs, every call from C++ into Lua is
+ * protected, so that the error never unwinds C++ frames. A nested call
+ * that runs out throws BudgetExceeded through the bound function that
+ * made it, and _lua_dispatcher raises the error again in Lua.
+ */
+class Watchdog : public CountHook::Client {
+private:
+    using Clock = std::chrono::steady_clock;
+
+    CountHook &_hook;
+    sel::Budget _budget;
+    // Thread of the outermost call while it runs
+    lua_State *_caller;
+    std::size_t _executed;
+    Clock::time_point _deadline;
+    BudgetLimit _overrun;
+
+    void OnCount(lua_State *l) override {
+        if (_caller == nullptr) {
+            CountHook::Restore(l);
+            return;
+        }
+        _executed += CountHook::Period;
+        if (_overrun == BudgetLimit::None) {
+            if (_budget.instructions != 0 &&
+                _executed > _budget.instructions) {
+                _overrun = BudgetLimit::Instructions;
+            } else if (_budget.time.count() != 0 &&
+                       Clock::now() > _deadline) {
+                _overrun = BudgetLimit::Time;
+            } else {
+                return;
+            }
+        }
+        CountHook::Soon(l);
+        CountHook::Soon(_caller);
+        luaL_error(l, "%s", _budget_message(_overrun));
+    }
+
+public:
+    Watchdog(CountHook &hook)
+        : _hook(hook), _caller(nullptr), _executed(0),
+          _overrun(BudgetLimit::None) {}
+    Watchdog(const Watchdog &) = delete;
+    Watchdog &operator=(const Watchdog &) = delete;
+    ~Watchdog() {
+        if (_hook.Get(CountHook::Budget) == this) {
+            _hook.Set(CountHook::Budget, nullptr);
+        }
+    }
+
+    const sel::Budget &GetBudget() const {
+        return _budget;
+    }
+
+    // Applies to the following outermost calls. The hook stays
+    // installed only while the budget is limited.
+    void SetBudget(const sel::Budget &budget) {
+        _budget = budget;
+        _hook.Set(CountHook::Budget, budget.Unlimited() ? nullptr : this);
+    }
+
+    // The limit the running or last outermost call exceeded
+    BudgetLimit Overrun() const {
+        return _overrun;
+    }
+
+    // The watchdog of l's state, nullptr if the budget is unlimited
+    static Watchdog *From(lua_State *l) {
+        CountHook *hook = CountHook::From(l);
+        if (hook == nullptr) return nullptr;
+        return static_cast<Watchdog *>(hook->Get(CountHook::Budget));
+    }
+
+    // The watchdog of l's state if a budgeted call is running
+    static Watchdog *Running(lua_State *l) {
+        Watchdog *watchdog = From(l);
+        return watchdog != nullptr && watchdog->_caller != nullptr
+            ? watchdog : nullptr;
+    }
+
+    // Returns the watchdog of l's state if a budgeted call starts,
+    // nullptr if the budget is unlimited or a call is already running
+    static Watchdog *Start(lua_State *l) {
+        Watchdog *watchdog = From(l);
+        if (watchdog == nullptr || watchdog->_caller != nullptr) {
+            return nullptr;
+        }
+        watchdog->_caller = l;
+        watchdog->_executed = 0;
+        watchdog->_deadline = Clock::now() + watchdog->_budget.time;
+        watchdog->_overrun = BudgetLimit::None;
+        return watchdog;
+    }
+
+    void Finish() {
+        CountHook::Restore(_caller);
+        _caller = nullptr;
+    }
+
+    [[noreturn]] void Throw() const {
+        throw BudgetExceeded(_overrun, _budget_message(_overrun));
+    }
+};
+
+/*
+ * Wraps a call from C++ into Lua. If it is the outermost one and the
+ * state has a budget, the call is budgeted. While a budgeted call
+ * runs, Call runs this call or the nested one protected and throws
+ * BudgetExceeded if the budget ran out. Other calls behave as before.
+ */
+class BudgetScope {
+private:
+    lua_State *_l;
+    // Set if this call is budgeted
+    Watchdog *_watchdog;
+    // Set if this call is budgeted or nested in a budgeted call
+    Watchdog *_running;
+
+public:
+    explicit BudgetScope(lua_State *l)
+        : _l(l), _watchdog(Watchdog::Start(l)),
+          _running(Watchdog::Running(l)) {}
+    BudgetScope(const BudgetScope &) = delete;
+    BudgetScope &operator=(const BudgetScope &) = delete;
+    ~BudgetScope() {
+        if (_watchdog != nullptr) _watchdog->Finish();
+    }
+
+    // Same as lua_call
+    void Call(int nargs, int nresults) {
+        if (_running == nullptr) {
+            lua_call(_l, nargs, nresults);
+            return;
+        }
+        if (lua_pcall(_l, nargs, nresults, 0) == 0) return;
+        if (_running->Overrun() != BudgetLimit::None) {
+            lua_pop(_l, 1);
+            _running->Throw();
+        }
+        // Other errors stay unprotected, as with lua_call
+        lua_error(_l);
+    }
+};
+}
+}
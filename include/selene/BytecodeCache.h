@@ -0,0 +1,202 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+
+extern "C" {
+#include <lua.h>
+#include <lauxlib.h>
+}
+
+namespace sel {
+namespace detail {
+// 64 bit FNV-1a
+inline std::uint64_t _hash(const char *data, std::size_t size) {
+    std::uint64_t hash = 14695981039346656037ULL;
+    for (std::size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+inline bool _read_file(const std::string &path, std::string &contents) {
+    std::ifstream file{path, std::ios::binary | std::ios::ate};
+    if (!file) return false;
+    const std::streamoff size = file.tellg();
+    if (size < 0) return false;
+    contents.resize(static_cast<std::size_t>(size));
+    file.seekg(0);
+    return size == 0 || file.read(&contents[0], size);
+}
+
+inline int _string_writer(lua_State *, const void *p, std::size_t size,
+                          void *ud) {
+    static_cast<std::string *>(ud)->append(static_cast<const char *>(p),
+                                           size);
+    return 0;
+}
+}
+
+/*
+ * Keeps the compiled form of loaded files in a directory. Entries are
+ * named after the path and a hash of the contents of the source, so an
+ * edited file is compiled again. Each entry starts with a header
+ * holding that hash and LUA_VERSION_NUM, and entries whose header does
+ * not match, or whose bytecode the running Lua rejects, are replaced.
+ * Writing the entry of an edited file removes the entries of its
+ * previous contents. Several processes may share the directory, which
+ * must exist.
+ *
+ * Lua does not verify bytecode, and malformed bytecode can crash the
+ * process or worse. The directory must therefore be writable only by
+ * trusted users.
+ */
+class BytecodeCache {
+private:
+    std::string _directory;
+    std::size_t _hits;
+    std::size_t _misses;
+
+    // Start of the names of the entries of a path
+    static std::string _prefix(const std::string &path) {
+        std::ostringstream prefix;
+        prefix << std::hex << detail::_hash(path.data(), path.size())
+               << '-';
+        return prefix.str();
+    }
+
+    std::string _entry(const std::string &prefix,
+                       std::uint64_t source_hash) const {
+        std::ostringstream name;
+        name << _directory << '/' << prefix << std::hex << source_hash
+             << ".luac";
+        return name.str();
+    }
+
+    // Removes the entries of prefix other than entry
+    void _remove_stale(const std::string &prefix,
+                       const std::string &entry) const {
+        DIR *dir = opendir(_directory.c_str());
+        if (dir == nullptr) return;
+        const std::string current = entry.substr(_directory.size() + 1);
+        const std::string suffix = ".luac";
+        while (dirent *file = readdir(dir)) {
+            const std::string name = file->d_name;
+            if (name != current && name.size() > prefix.size() &&
+                name.compare(0, prefix.size(), prefix) == 0 &&
+                name.compare(name.size() - suffix.size(), suffix.size(),
+                             suffix) == 0) {
+                std::remove((_directory + '/' + name).c_str());
+            }
+        }
+        closedir(dir);
+    }
+
+    // Line preceding the bytecode in an entry
+    static std::string _header(std::uint64_t source_hash) {
+        std::ostringstream header;
+        header << "selene " << LUA_VERSION_NUM << ' ' << std::hex
+               << source_hash << '\n';
+        return header.str();
+    }
+
+    static int _load(lua_State *l, const char *code, std::size_t size,
+                     const std::string &chunkname, const char *mode) {
+#if LUA_VERSION_NUM >= 502
+        return luaL_loadbufferx(l, code, size, chunkname.c_str(), mode);
+#else
+        (void)mode;
+        return luaL_loadbuffer(l, code, size, chunkname.c_str());
+#endif
+    }
+
+    // Writes through a temporary file so readers never see a partial
+    // entry. Returns true if the entry was written.
+    bool _store(const std::string &entry, const std::string &header,
+                const std::string &code) const {
+        std::string tmp = _directory + "/.tmp-XXXXXX";
+        const int fd = mkstemp(&tmp[0]);
+        if (fd < 0) return false;
+        FILE *file = fdopen(fd, "wb");
+        if (file == nullptr) {
+            close(fd);
+            std::remove(tmp.c_str());
+            return false;
+        }
+        const bool written =
+            std::fwrite(header.data(), 1, header.size(), file) ==
+                header.size() &&
+            std::fwrite(code.data(), 1, code.size(), file) == code.size();
+        if (std::fclose(file) != 0 || !written ||
+            std::rename(tmp.c_str(), entry.c_str()) != 0) {
+            std::remove(tmp.c_str());
+            return false;
+        }
+        return true;
+    }
+
+public:
+    BytecodeCache(const std::string &directory)
+        : _directory(directory), _hits(0), _misses(0) {}
+
+    // Loads the file as a function on top of the stack, like
+    // luaL_loadfile. On error the message is pushed instead.
+    int LoadFile(lua_State *l, const std::string &path) {
+        std::string source;
+        if (!detail::_read_file(path, source)) {
+            lua_pushfstring(l, "cannot read %s", path.c_str());
+            return LUA_ERRFILE;
+        }
+        const std::string chunkname = "@" + path;
+        const std::uint64_t source_hash =
+            detail::_hash(source.data(), source.size());
+        const std::string prefix = _prefix(path);
+        const std::string entry = _entry(prefix, source_hash);
+        const std::string header = _header(source_hash);
+        std::string code;
+        if (detail::_read_file(entry, code) &&
+            code.size() > header.size() &&
+            code.compare(0, header.size(), header) == 0 &&
+            code[header.size()] == LUA_SIGNATURE[0]) {
+            if (_load(l, code.data() + header.size(),
+                      code.size() - header.size(), chunkname, "b") == 0) {
+                ++_hits;
+                return 0;
+            }
+            lua_pop(l, 1);
+        }
+        ++_misses;
+        // Comment out a leading #! line, keeping line numbers intact
+        if (!source.empty() && source[0] == '#') {
+            source.insert(0, "--");
+        }
+        // The file may be precompiled, as with luaL_loadfile
+        const int status = _load(l, source.data(), source.size(),
+                                 chunkname, "bt");
+        if (status != 0) return status;
+        code.clear();
+#if LUA_VERSION_NUM >= 503
+        lua_dump(l, &detail::_string_writer, &code, 0);
+#else
+        lua_dump(l, &detail::_string_writer, &code);
+#endif
+        if (_store(entry, header, code)) _remove_stale(prefix, entry);
+        return 0;
+    }
+
+    std::size_t Hits() const {
+        return _hits;
+    }
+
+    std::size_t Misses() const {
+        return _misses;
+    }
+};
+}
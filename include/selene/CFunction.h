@@ -0,0 +1,72 @@
+#pragma once
+
+#include "primitives.h"
+#include <tuple>
+#include "traits.h"
+
+namespace sel {
+/*
+ * A lua_CFunction assigned to a Selector or passed to Lua as is. Unlike
+ * other bindings it costs no std::function, Registry entry or virtual
+ * call, so it is not counted by SELENE_BINDING_STATS either.
+ */
+struct CFunction {
+    lua_CFunction function;
+};
+
+namespace detail {
+inline void _push(lua_State *l, CFunction fun) {
+    lua_pushcfunction(l, fun.function);
+}
+
+// One lua_CFunction per free function f. Arguments are checked like
+// those of other bindings; results are pushed without the metatables
+// of registered classes, as there is no Registry to find them in.
+template <typename F, F f>
+struct _trampoline;
+
+template <typename Ret, typename... Args, Ret (*f)(Args...)>
+struct _trampoline<Ret (*)(Args...), f> {
+    template <std::size_t... N>
+    static int _apply(lua_State *l, _indices<N...>) {
+        std::tuple<Args...> args{_check_get(_id<Args>{}, l, N + 1)...};
+        _push(l, f(std::get<N>(args)...));
+        return _arity<Ret>::value;
+    }
+
+    static int Call(lua_State *l) {
+        return _apply(l, typename _indices_builder<sizeof...(Args)>::type());
+    }
+};
+
+template <typename... Args, void (*f)(Args...)>
+struct _trampoline<void (*)(Args...), f> {
+    template <std::size_t... N>
+    static int _apply(lua_State *l, _indices<N...>) {
+        (void)l; // unused when f takes no arguments
+        std::tuple<Args...> args{_check_get(_id<Args>{}, l, N + 1)...};
+        f(std::get<N>(args)...);
+        return 0;
+    }
+
+    static int Call(lua_State *l) {
+        return _apply(l, typename _indices_builder<sizeof...(Args)>::type());
+    }
+};
+}
+
+// Binds a free function known at compile time:
+//   state["add"] = sel::bind<decltype(&add), &add>();
+template <typename F, F f>
+CFunction bind() {
+    return CFunction{&detail::_trampoline<F, f>::Call};
+}
+
+#if __cplusplus >= 201703L
+// Same as above: state["add"] = sel::bind<&add>();
+template <auto f>
+CFunction bind() {
+    return CFunction{&detail::_trampoline<decltype(f), f>::Call};
+}
+#endif
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Budget.h"
+#include "LuaRef.h"
+#include "primitives.h"
+#include <stdexcept>
+#include <string>
+#include "util.h"
+
+namespace sel {
+/*
+ * A snippet of code compiled once by State::Compile and run as often
+ * as needed without parsing it again
+ */
+class Chunk {
+private:
+    lua_State *_state;
+    LuaRef _ref;
+    std::string _error;
+
+public:
+    // Takes the compiled function from the top of the stack
+    Chunk(lua_State *l)
+        : _state(l), _ref(l, luaL_ref(l, LUA_REGISTRYINDEX)) {}
+
+    // A chunk that failed to compile
+    Chunk(lua_State *l, const std::string &error)
+        : _state(l), _ref(l, LUA_REFNIL), _error(error) {}
+
+    explicit operator bool() const {
+        return _error.empty();
+    }
+
+    // The compilation error, empty if there was none
+    const std::string &Error() const {
+        return _error;
+    }
+
+    // Runs the chunk. Returns false if it failed to compile or raised
+    // an error.
+    bool operator()() const {
+        if (!_error.empty()) return false;
+        detail::ResetStackOnScopeExit save(_state);
+        _ref.Push(_state);
+        detail::BudgetScope budget(_state);
+        return lua_pcall(_state, 0, 0, 0) == 0;
+    }
+
+    // Runs the chunk and returns the values it returns, as
+    // Selector::Call does. Throws std::runtime_error with the
+    // compilation error if it failed to compile.
+    template <typename... Ret>
+    typename detail::_pop_n_impl<sizeof...(Ret), Ret...>::type
+    Call() const {
+        if (!_error.empty()) throw std::runtime_error(_error);
+        detail::ResetStackOnScopeExit save(_state);
+        _ref.Push(_state);
+        detail::BudgetScope budget(_state);
+        budget.Call(0, sizeof...(Ret));
+        return detail::_pop_n<Ret...>(_state);
+    }
+};
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+extern "C" {
+#include <lua.h>
+#include <lauxlib.h>
+}
+
+namespace sel {
+/*
+ * Keeps the functions compiled from the most recently run snippets of
+ * code, up to a fixed number, so running one again skips the parser.
+ * Entries are referenced from the registry and released when they are
+ * evicted or the state is closed.
+ */
+class ChunkCache {
+private:
+    using Entry = std::pair<std::string, int>;
+    std::size_t _capacity;
+    // Most recently used first
+    std::list<Entry> _entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> _index;
+    std::size_t _hits;
+    std::size_t _misses;
+
+public:
+    ChunkCache(std::size_t capacity)
+        : _capacity(capacity), _hits(0), _misses(0) {}
+
+    // Pushes the function compiled from code, like luaL_loadstring. On
+    // error the message is pushed instead.
+    int Load(lua_State *l, const char *code) {
+        std::string key{code};
+        auto it = _index.find(key);
+        if (it != _index.end()) {
+            ++_hits;
+            _entries.splice(_entries.begin(), _entries, it->second);
+            lua_rawgeti(l, LUA_REGISTRYINDEX, it->second->second);
+            return 0;
+        }
+        ++_misses;
+        const int status = luaL_loadstring(l, code);
+        if (status != 0) return status;
+        if (_entries.size() >= _capacity) {
+            luaL_unref(l, LUA_REGISTRYINDEX, _entries.back().second);
+            _index.erase(_entries.back().first);
+            _entries.pop_back();
+        }
+        lua_pushvalue(l, -1);
+        _entries.emplace_front(key, luaL_ref(l, LUA_REGISTRYINDEX));
+        _index.emplace(std::move(key), _entries.begin());
+        return 0;
+    }
+
+    // Releases all entries
+    void Clear(lua_State *l) {
+        for (const Entry &entry : _entries) {
+            luaL_unref(l, LUA_REGISTRYINDEX, entry.second);
+        }
+        _entries.clear();
+        _index.clear();
+    }
+
+    std::size_t Hits() const {
+        return _hits;
+    }
+
+    std::size_t Misses() const {
+        return _misses;
+    }
+
+    std::size_t Size() const {
+        return _entries.size();
+    }
+
+    std::size_t Capacity() const {
+        return _capacity;
+    }
+};
+}
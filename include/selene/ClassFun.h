@@ -14,7 +14,8 @@ private:
     std::string _metatable_name;
 
     T *_get(lua_State *state) {
-        T *ret = (T *)luaL_checkudata(state, 1, _metatable_name.c_str());
+        T *ret = (T *)detail::_check_udata(state, 1,
+                                            _metatable_name.c_str());
         lua_remove(state, 1);
         return ret;
     }
@@ -55,7 +56,8 @@ private:
     std::string _metatable_name;
 
     T *_get(lua_State *state) {
-        T *ret = (T *)luaL_checkudata(state, 1, _metatable_name.c_str());
+        T *ret = (T *)detail::_check_udata(state, 1,
+                                            _metatable_name.c_str());
         lua_remove(state, 1);
         return ret;
     }
@@ -0,0 +1,179 @@
+#pragma once
+
+#include "Budget.h"
+#include "primitives.h"
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace sel {
+class EventLoop;
+
+namespace detail {
+// Sets nresults to the number of values yielded or returned, which
+// are on top of the stack of thread. Since Lua 5.4 the stack may hold
+// other values below them.
+inline int _resume(lua_State *thread, lua_State *from, int nargs,
+                   int &nresults) {
+#if LUA_VERSION_NUM >= 504
+    return lua_resume(thread, from, nargs, &nresults);
+#else
+#if LUA_VERSION_NUM >= 502
+    const int status = lua_resume(thread, from, nargs);
+#else
+    (void)from;
+    const int status = lua_resume(thread, nargs);
+#endif
+    nresults = lua_gettop(thread);
+    return status;
+#endif
+}
+}
+
+/*
+ * Lua threads kept for reuse by Coroutines of a State. A thread whose
+ * function returned normally can run a new function; threads that
+ * raised an error are left to the garbage collector.
+ */
+class CoroutinePool {
+private:
+    lua_State *_state;
+    // Idle threads and the registry references keeping them alive
+    std::vector<std::pair<lua_State *, int>> _idle;
+    std::size_t _created;
+
+public:
+    CoroutinePool(lua_State *l) : _state(l), _created(0) {}
+    CoroutinePool(const CoroutinePool &) = delete;
+    CoroutinePool &operator=(const CoroutinePool &) = delete;
+
+    std::pair<lua_State *, int> Acquire() {
+        if (!_idle.empty()) {
+            auto thread = _idle.back();
+            _idle.pop_back();
+            // Pick up a hook (e.g. a Profiler's) set since the thread
+            // was created
+            lua_sethook(thread.first, lua_gethook(_state),
+                        lua_gethookmask(_state), lua_gethookcount(_state));
+            return thread;
+        }
+        ++_created;
+        lua_State *thread = lua_newthread(_state);
+        return {thread, luaL_ref(_state, LUA_REGISTRYINDEX)};
+    }
+
+    void Release(lua_State *thread, int ref) {
+        if (lua_status(thread) == 0 && lua_gettop(thread) == 0) {
+            _idle.emplace_back(thread, ref);
+        } else {
+            luaL_unref(_state, LUA_REGISTRYINDEX, ref);
+        }
+    }
+
+    // Number of threads ever created by the pool
+    std::size_t Created() const {
+        return _created;
+    }
+
+    std::size_t Idle() const {
+        return _idle.size();
+    }
+};
+
+enum class CoroutineStatus {
+    // Not started yet or waiting after a yield
+    Suspended,
+    // The function returned
+    Finished,
+    // The function raised an error, see Coroutine::Error()
+    Error
+};
+
+/*
+ * Runs a Lua function on its own Lua thread, driven from C++ with
+ * Resume. Obtain one via State::NewCoroutine. When a Coroutine is
+ * destroyed, its thread goes back to the State's pool if it can be
+ * reused. A Coroutine must not outlive its State.
+ */
+class Coroutine {
+    friend class EventLoop;
+private:
+    CoroutinePool *_pool;
+    lua_State *_thread;
+    int _ref;
+    CoroutineStatus _status;
+    std::string _error;
+    // Values yielded or returned by the last resume, not read yet
+    int _results;
+
+    // Resumes the thread with the nargs values on top of its stack
+    void _resume(int nargs) {
+        detail::BudgetScope budget(_thread);
+        const int status =
+            detail::_resume(_thread, nullptr, nargs, _results);
+        if (status == 0) {
+            _status = CoroutineStatus::Finished;
+        } else if (status != LUA_YIELD) {
+            _status = CoroutineStatus::Error;
+            const char *message = lua_tostring(_thread, -1);
+            _error = message != nullptr ? message : "";
+            lua_settop(_thread, 0);
+            _results = 0;
+        }
+    }
+
+public:
+    // Expects the function on top of the stack of l, and pops it
+    Coroutine(lua_State *l, CoroutinePool &pool)
+        : _pool(&pool), _status(CoroutineStatus::Suspended), _results(0) {
+        std::tie(_thread, _ref) = pool.Acquire();
+        lua_xmove(l, _thread, 1);
+    }
+    Coroutine(const Coroutine &) = delete;
+    Coroutine &operator=(const Coroutine &) = delete;
+    Coroutine(Coroutine &&other)
+        : _pool(other._pool), _thread(other._thread), _ref(other._ref),
+          _status(other._status), _error(std::move(other._error)),
+          _results(other._results) {
+        other._thread = nullptr;
+    }
+    ~Coroutine() {
+        if (_thread == nullptr) return;
+        // Drops a function that never ran. A thread suspended in a
+        // yield is not reused.
+        lua_settop(_thread, 0);
+        _pool->Release(_thread, _ref);
+    }
+
+    // Passes args to the coroutine, as the function's arguments the
+    // first time and as the results of yield afterwards, and runs it
+    // until it yields or returns. The yielded or returned values are
+    // converted as Selector::Call does; missing ones read as nil.
+    // Resuming a coroutine that is not suspended does nothing.
+    template <typename... Ret, typename... Args>
+    typename detail::_pop_n_impl<sizeof...(Ret), Ret...>::type
+    Resume(Args&&... args) {
+        if (_status == CoroutineStatus::Suspended) {
+            const int base = lua_gettop(_thread);
+            detail::_push_refs(_thread, args...);
+            _resume(lua_gettop(_thread) - base);
+        }
+        // Keeps the first of the values on top, padded with nil, and
+        // pops them all for the next resume
+        const int below = lua_gettop(_thread) - _results;
+        lua_settop(_thread, below + int(sizeof...(Ret)));
+        _results = 0;
+        return detail::_pop_n<Ret...>(_thread);
+    }
+
+    CoroutineStatus Status() const {
+        return _status;
+    }
+
+    // The error message if Status() is CoroutineStatus::Error
+    const std::string &Error() const {
+        return _error;
+    }
+};
+}
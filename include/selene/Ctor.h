@@ -16,7 +16,7 @@ public:
         _ctor = [metatable_name](lua_State *state, Args... args) {
             void *addr = lua_newuserdata(state, sizeof(T));
             new(addr) T(args...);
-            luaL_setmetatable(state, metatable_name.c_str());
+            detail::_set_metatable(state, metatable_name.c_str());
         };
         lua_pushlightuserdata(l, (void *)static_cast<BaseFun *>(this));
         lua_pushcclosure(l, &detail::_lua_dispatcher, 1);
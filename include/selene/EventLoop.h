@@ -0,0 +1,134 @@
+#pragma once
+
+#include "Coroutine.h"
+#include "Future.h"
+#include <memory>
+#include "State.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace sel {
+/*
+ * Runs Lua functions as tasks that can wait for Futures returned by
+ * bound C++ functions. A task waiting for a Future yields and is
+ * resumed by RunOnce or Run once the Future's Promise is set, which
+ * may happen on any thread. Tasks are only ever resumed on the thread
+ * calling RunOnce or Run.
+ *
+ * A task may also call coroutine.yield() directly to let others run;
+ * it is resumed on the next round. There can be one EventLoop per
+ * State at a time.
+ */
+class EventLoop {
+private:
+    struct Task : public detail::AsyncTask {
+        EventLoop *loop;
+        Coroutine coroutine;
+
+        Task(EventLoop *l, Coroutine &&c) : loop(l), coroutine(std::move(c)) {}
+
+        void Resume(const std::function<int(lua_State *)> &push) override {
+            loop->_resume(this, push(coroutine._thread));
+        }
+    };
+
+    lua_State *_l;
+    State &_state;
+    detail::Scheduler _scheduler;
+    std::unordered_map<Task *, std::unique_ptr<Task>> _tasks;
+    std::vector<std::string> _errors;
+
+    // Resumes task with the nargs values on top of its stack. Finished
+    // tasks are destroyed.
+    void _resume(Task *task, int nargs) {
+        detail::AsyncTask *outer = _scheduler.Running();
+        lua_State *outer_thread = _scheduler.RunningThread();
+        lua_State *thread = task->coroutine._thread;
+        _scheduler.SetRunning(task, thread);
+        task->coroutine._resume(nargs);
+        const bool awaiting = _scheduler.Awaiting();
+        _scheduler.SetRunning(outer, outer_thread);
+        switch (task->coroutine.Status()) {
+        case CoroutineStatus::Suspended:
+            // Values passed to coroutine.yield are dropped
+            lua_settop(thread, 0);
+            task->coroutine._results = 0;
+            if (!awaiting) {
+                detail::Scheduler::Post(_scheduler.GetQueue(), task,
+                                        [](lua_State *) { return 0; });
+            }
+            break;
+        case CoroutineStatus::Error:
+            _errors.push_back(task->coroutine.Error());
+            _tasks.erase(task);
+            break;
+        case CoroutineStatus::Finished:
+            lua_settop(thread, 0);
+            _tasks.erase(task);
+            break;
+        }
+    }
+
+public:
+    EventLoop(State &state) : _l(state._l), _state(state) {
+        detail::Scheduler::Install(_l, &_scheduler);
+    }
+    EventLoop(const EventLoop &) = delete;
+    EventLoop &operator=(const EventLoop &) = delete;
+    ~EventLoop() {
+        detail::Scheduler::Install(_l, nullptr);
+    }
+
+    // Starts a task running the selected function with args. It runs
+    // until it first waits or yields.
+    template <typename... Args>
+    void Spawn(const Selector &function, Args&&... args) {
+        std::unique_ptr<Task> task{new Task{this, _state.NewCoroutine(function)}};
+        Task *t = task.get();
+        _tasks.emplace(t, std::move(task));
+        lua_State *thread = t->coroutine._thread;
+        const int base = lua_gettop(thread);
+        detail::_push_refs(thread, args...);
+        _resume(t, lua_gettop(thread) - base);
+    }
+
+    // Resumes the tasks that are ready without blocking. Returns how
+    // many were resumed.
+    std::size_t RunOnce() {
+        std::deque<detail::Scheduler::Continuation> ready;
+        {
+            const auto &queue = _scheduler.GetQueue();
+            std::lock_guard<std::mutex> lock{queue->mutex};
+            ready.swap(queue->continuations);
+        }
+        for (auto &continuation : ready) {
+            continuation.first->Resume(continuation.second);
+        }
+        return ready.size();
+    }
+
+    // Runs until all tasks have finished, blocking while they wait.
+    // Does not return if a task waits for a Future that is never set.
+    void Run() {
+        while (!_tasks.empty()) {
+            if (RunOnce() > 0) continue;
+            const auto &queue = _scheduler.GetQueue();
+            std::unique_lock<std::mutex> lock{queue->mutex};
+            queue->ready.wait(lock, [&queue]() {
+                    return !queue->continuations.empty();
+                });
+        }
+    }
+
+    // Number of tasks that have not finished
+    std::size_t Tasks() const {
+        return _tasks.size();
+    }
+
+    // Messages of the errors raised by tasks
+    const std::vector<std::string> &Errors() const {
+        return _errors;
+    }
+};
+}
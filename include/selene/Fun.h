@@ -1,6 +1,7 @@
 #pragma once
 
 #include "BaseFun.h"
+#include "Future.h"
 #include "MetatableRegistry.h"
 #include <string>
 
@@ -30,8 +31,7 @@ public:
     int Apply(lua_State *l) override {
         std::tuple<Args...> args = detail::_get_args<Args...>(l);
         Ret value = detail::_lift(_fun, args);
-        detail::_push(l, _meta_registry, std::forward<Ret>(value));
-        return N;
+        return detail::_return(l, _meta_registry, std::forward<Ret>(value), N);
     }
 
 };
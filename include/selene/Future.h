@@ -0,0 +1,238 @@
+#pragma once
+
+#include "BaseFun.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+namespace sel {
+namespace detail {
+template <typename T>
+class FutureState {
+private:
+    std::mutex _mutex;
+    bool _ready = false;
+    T _value{};
+    std::function<void()> _callback;
+
+public:
+    bool Ready() {
+        std::lock_guard<std::mutex> lock{_mutex};
+        return _ready;
+    }
+
+    // Only valid once Ready()
+    const T &Value() const {
+        return _value;
+    }
+
+    void Set(T value) {
+        std::unique_lock<std::mutex> lock{_mutex};
+        _value = std::move(value);
+        _ready = true;
+        std::function<void()> callback = std::move(_callback);
+        lock.unlock();
+        if (callback) callback();
+    }
+
+    // Runs callback once the value is set, right away if it already is
+    void OnReady(std::function<void()> callback) {
+        std::unique_lock<std::mutex> lock{_mutex};
+        if (!_ready) {
+            _callback = std::move(callback);
+            return;
+        }
+        lock.unlock();
+        callback();
+    }
+};
+}
+
+/*
+ * The result of an asynchronous operation. A function bound with
+ * State::operator[] may return a Future. When it is called from a
+ * task of an EventLoop and the value is not ready yet, the task yields
+ * and is resumed with the value once it is set.
+ */
+template <typename T>
+class Future {
+private:
+    std::shared_ptr<detail::FutureState<T>> _state;
+
+public:
+    Future(std::shared_ptr<detail::FutureState<T>> state)
+        : _state(std::move(state)) {}
+
+    bool Ready() const {
+        return _state->Ready();
+    }
+
+    // Only valid once Ready()
+    const T &Get() const {
+        return _state->Value();
+    }
+
+    std::shared_ptr<detail::FutureState<T>> Shared() const {
+        return _state;
+    }
+};
+
+// Sets the value of a Future, from any thread
+template <typename T>
+class Promise {
+private:
+    std::shared_ptr<detail::FutureState<T>> _state;
+
+public:
+    Promise() : _state(std::make_shared<detail::FutureState<T>>()) {}
+
+    Future<T> GetFuture() const {
+        return Future<T>{_state};
+    }
+
+    void Set(T value) const {
+        _state->Set(std::move(value));
+    }
+};
+
+namespace detail {
+// Lua thread waiting for a value. Implemented by EventLoop.
+struct AsyncTask {
+    virtual ~AsyncTask() {}
+    // Resumes the thread with the values pushed by push, which
+    // returns how many it pushed
+    virtual void Resume(const std::function<int(lua_State *)> &push) = 0;
+};
+
+/*
+ * The part of an EventLoop seen by bound functions. It is found
+ * through the Lua registry and knows which task is running.
+ */
+class Scheduler {
+public:
+    using Continuation = std::pair<AsyncTask *, std::function<int(lua_State *)>>;
+
+    // Continuations ready to run, shared with the callbacks of pending
+    // futures so they can outlive the loop
+    struct Queue {
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::deque<Continuation> continuations;
+    };
+
+private:
+    std::shared_ptr<Queue> _queue;
+    AsyncTask *_running;
+    lua_State *_running_thread;
+    bool _awaiting;
+
+    static void *_key() {
+        static char key;
+        return &key;
+    }
+
+public:
+    Scheduler() : _queue(std::make_shared<Queue>()), _running(nullptr),
+                  _running_thread(nullptr), _awaiting(false) {}
+
+    // Makes this the scheduler of the state, or of none if nullptr
+    static void Install(lua_State *l, Scheduler *scheduler) {
+        lua_pushlightuserdata(l, _key());
+        if (scheduler == nullptr) {
+            lua_pushnil(l);
+        } else {
+            lua_pushlightuserdata(l, scheduler);
+        }
+        lua_rawset(l, LUA_REGISTRYINDEX);
+    }
+
+    static Scheduler *From(lua_State *l) {
+        lua_pushlightuserdata(l, _key());
+        lua_rawget(l, LUA_REGISTRYINDEX);
+        void *scheduler = lua_touserdata(l, -1);
+        lua_pop(l, 1);
+        return static_cast<Scheduler *>(scheduler);
+    }
+
+    const std::shared_ptr<Queue> &GetQueue() const {
+        return _queue;
+    }
+
+    // Thread safe
+    static void Post(const std::shared_ptr<Queue> &queue, AsyncTask *task,
+                     std::function<int(lua_State *)> push) {
+        {
+            std::lock_guard<std::mutex> lock{queue->mutex};
+            queue->continuations.emplace_back(task, std::move(push));
+        }
+        queue->ready.notify_one();
+    }
+
+    // Records the task being resumed, nullptr for none
+    void SetRunning(AsyncTask *task, lua_State *thread) {
+        _running = task;
+        _running_thread = thread;
+        _awaiting = false;
+    }
+
+    AsyncTask *Running() const {
+        return _running;
+    }
+
+    lua_State *RunningThread() const {
+        return _running_thread;
+    }
+
+    // True if the task that ran last is waiting for a future
+    bool Awaiting() const {
+        return _awaiting;
+    }
+
+    // Arranges for the running task to be resumed with the value of
+    // future. Returns false if l is not the thread of a task.
+    template <typename T>
+    bool Await(lua_State *l, const Future<T> &future) {
+        if (_running == nullptr || l != _running_thread) return false;
+        _awaiting = true;
+        std::weak_ptr<Queue> queue = _queue;
+        AsyncTask *task = _running;
+        std::shared_ptr<FutureState<T>> state = future.Shared();
+        state->OnReady([queue, task, state]() {
+                if (auto q = queue.lock()) {
+                    Post(q, task, [state](lua_State *thread) {
+                            _push_refs(thread, state->Value());
+                            return 1;
+                        });
+                }
+            });
+        return true;
+    }
+};
+
+// Pushes the result of a bound function and returns how many values
+// Lua receives, or one of the requests handled by _lua_dispatcher
+template <typename T>
+int _return(lua_State *l, MetatableRegistry &m, T &&value, int n) {
+    _push(l, m, std::forward<T>(value));
+    return n;
+}
+
+template <typename T>
+int _return(lua_State *l, MetatableRegistry &, Future<T> &&future, int) {
+    if (future.Ready()) {
+        _push_refs(l, future.Get());
+        return 1;
+    }
+    Scheduler *scheduler = Scheduler::From(l);
+    if (scheduler == nullptr || !scheduler->Await(l, future)) {
+        lua_pushstring(l, "a Future can only be waited for by an "
+                       "EventLoop task");
+        return _raise_error;
+    }
+    return _yield;
+}
+}
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+extern "C" {
+#include <lua.h>
+#include <lauxlib.h>
+#if LUA_VERSION_NUM < 502 && defined(__has_include)
+#if __has_include(<luajit.h>)
+#include <luajit.h>
+#endif
+#endif
+}
+
+namespace sel {
+namespace detail {
+/*
+ * The count hook of a state. Lua has a single hook per thread, which
+ * is shared by the Profiler and execution budgets: each registers a
+ * Client, and the hook is installed while there is one. Threads
+ * created afterwards inherit it; CoroutinePool copies it to pooled
+ * threads.
+ *
+ * Code compiled by LuaJIT does not call hooks, so the JIT compiler is
+ * turned off and its traces flushed while the hook is installed.
+ */
+class CountHook {
+public:
+    // VM instructions between two calls of the clients
+    static constexpr int Period = 1000;
+
+    class Client {
+    public:
+        virtual ~Client() {}
+        // May raise a Lua error
+        virtual void OnCount(lua_State *l) = 0;
+    };
+
+    // The profiler runs before the budget, which may raise
+    enum Slot { Profiling, Budget, Slots };
+
+private:
+    lua_State *_l;
+    Client *_clients[Slots];
+    bool _jit_was_on;
+
+    static void *_key() {
+        static char key;
+        return &key;
+    }
+
+    static void _hook(lua_State *l, lua_Debug *) {
+        CountHook *hook = From(l);
+        if (hook == nullptr) {
+            // Left on a thread after the hook was removed
+            lua_sethook(l, nullptr, 0, 0);
+            return;
+        }
+        for (Client *client : hook->_clients) {
+            if (client != nullptr) client->OnCount(l);
+        }
+    }
+
+#ifdef LUAJIT_VERSION
+    // jit.status(), false if the jit library is not loaded
+    bool _jit_on() {
+        bool result = false;
+        lua_getfield(_l, LUA_REGISTRYINDEX, "_LOADED");
+        if (lua_istable(_l, -1)) {
+            lua_getfield(_l, -1, "jit");
+            if (lua_istable(_l, -1)) {
+                lua_getfield(_l, -1, "status");
+                if (lua_isfunction(_l, -1)) {
+                    lua_call(_l, 0, 1);
+                    result = lua_toboolean(_l, -1) != 0;
+                }
+                lua_pop(_l, 1);
+            }
+            lua_pop(_l, 1);
+        }
+        lua_pop(_l, 1);
+        return result;
+    }
+#endif
+
+    void _set_jit(bool on) {
+#ifdef LUAJIT_VERSION
+        if (!on) {
+            _jit_was_on = _jit_on();
+            if (!_jit_was_on) return;
+            luaJIT_setmode(_l, 0, LUAJIT_MODE_ENGINE | LUAJIT_MODE_OFF);
+            luaJIT_setmode(_l, 0, LUAJIT_MODE_ENGINE | LUAJIT_MODE_FLUSH);
+        } else if (_jit_was_on) {
+            luaJIT_setmode(_l, 0, LUAJIT_MODE_ENGINE | LUAJIT_MODE_ON);
+        }
+#else
+        (void)on;
+#endif
+    }
+
+    void _install(bool on) {
+        lua_pushlightuserdata(_l, _key());
+        if (on) {
+            lua_pushlightuserdata(_l, this);
+        } else {
+            lua_pushnil(_l);
+        }
+        lua_rawset(_l, LUA_REGISTRYINDEX);
+        _set_jit(!on);
+        if (on) {
+            lua_sethook(_l, &_hook, LUA_MASKCOUNT, Period);
+        } else {
+            lua_sethook(_l, nullptr, 0, 0);
+        }
+    }
+
+public:
+    CountHook(lua_State *l) : _l(l), _clients{}, _jit_was_on(false) {}
+    CountHook(const CountHook &) = delete;
+    CountHook &operator=(const CountHook &) = delete;
+    ~CountHook() {
+        for (Client *client : _clients) {
+            if (client != nullptr) {
+                _install(false);
+                return;
+            }
+        }
+    }
+
+    // Finds the hook of the state l belongs to without touching the
+    // registry if it is not installed on l
+    static CountHook *From(lua_State *l) {
+        if (lua_gethook(l) != &_hook) return nullptr;
+        lua_pushlightuserdata(l, _key());
+        lua_rawget(l, LUA_REGISTRYINDEX);
+        void *hook = lua_touserdata(l, -1);
+        lua_pop(l, 1);
+        return static_cast<CountHook *>(hook);
+    }
+
+    Client *Get(Slot slot) const {
+        return _clients[slot];
+    }
+
+    // nullptr removes the client of slot
+    void Set(Slot slot, Client *client) {
+        bool before = false, after = false;
+        for (int i = 0; i < Slots; ++i) {
+            before = before || _clients[i] != nullptr;
+            if (i == slot) _clients[i] = client;
+            after = after || _clients[i] != nullptr;
+        }
+        if (before != after) _install(after);
+    }
+
+    // Makes the clients run after the next instruction on l instead of
+    // after Period instructions
+    static void Soon(lua_State *l) {
+        lua_sethook(l, &_hook, LUA_MASKCOUNT, 1);
+    }
+
+    // Undoes Soon
+    static void Restore(lua_State *l) {
+        if (lua_gethook(l) == &_hook && lua_gethookcount(l) != Period) {
+            lua_sethook(l, &_hook, LUA_MASKCOUNT, Period);
+        }
+    }
+};
+}
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "LuaRef.h"
+#include <string>
+
+namespace sel {
+/*
+ * A field name interned once in the registry. Using a Key instead of
+ * a string with Selector, BoundSelector, Table or TableBuilder pushes
+ * the existing Lua string with a registry lookup instead of creating
+ * it. For short names that costs about as much as lua_pushstring, see
+ * bench_key.
+ *
+ * Like the field names passed to operator[], a Key must outlive the
+ * selectors created from it. Obtain one via State::Intern.
+ */
+class Key {
+private:
+    std::string _name;
+    LuaRef _ref;
+    // Registry slot of the string, shared by all copies
+    int _id;
+
+    static int _intern(lua_State *l, const std::string &name) {
+        lua_pushlstring(l, name.data(), name.size());
+        return luaL_ref(l, LUA_REGISTRYINDEX);
+    }
+
+    Key(lua_State *l, const std::string &name, int id)
+        : _name(name), _ref(l, id), _id(id) {}
+
+public:
+    Key(lua_State *l, const std::string &name)
+        : Key(l, name, _intern(l, name)) {}
+
+    const std::string &Name() const {
+        return _name;
+    }
+
+    int Id() const {
+        return _id;
+    }
+
+    void Push(lua_State *l) const {
+        lua_rawgeti(l, LUA_REGISTRYINDEX, _id);
+    }
+};
+}
@@ -28,8 +28,19 @@ public:
     LuaRef(lua_State *state, int ref)
         : _ref(new int{ref}, detail::LuaRefDeleter{state}) {}
 
-    void Push(lua_State *state) {
+    void Push(lua_State *state) const {
         lua_rawgeti(state, LUA_REGISTRYINDEX, *_ref);
     }
+
+    // Makes the reference point at the value on top of the stack,
+    // which is popped. The value must not be nil.
+    void Replace(lua_State *state) const {
+        lua_rawseti(state, LUA_REGISTRYINDEX, *_ref);
+    }
+
+    // True if both handles share the same reference
+    bool operator==(const LuaRef &other) const {
+        return _ref == other._ref;
+    }
 };
 }
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace sel {
+namespace detail {
+/*
+ * Read only view of a whole file, mapped into memory for as long as
+ * the object lives
+ */
+class MappedFile {
+private:
+    const char *_data;
+    std::size_t _size;
+    bool _valid;
+
+public:
+    MappedFile(const std::string &path)
+        : _data(nullptr), _size(0), _valid(false) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat info;
+        if (fstat(fd, &info) == 0) {
+            _size = std::size_t(info.st_size);
+            if (_size == 0) {
+                _valid = true;
+            } else {
+                void *data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (data != MAP_FAILED) {
+                    _data = static_cast<const char *>(data);
+                    _valid = true;
+                }
+            }
+        }
+        close(fd);
+    }
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile() {
+        if (_data != nullptr) {
+            munmap(const_cast<char *>(_data), _size);
+        }
+    }
+
+    explicit operator bool() const {
+        return _valid;
+    }
+
+    const char *Data() const {
+        return _data;
+    }
+
+    std::size_t Size() const {
+        return _size;
+    }
+};
+}
+}
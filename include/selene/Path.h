@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <lua.h>
+#include <lauxlib.h>
+}
+
+namespace sel {
+namespace detail {
+/*
+ * A single step of a Selector's path. Field names are not copied so
+ * they must outlive the Selector, as string literals do.
+ */
+struct PathKey {
+    // nullptr when the key is the integer index
+    const char *field;
+    int index;
+    // Registry slot of the interned field name, LUA_NOREF if the
+    // field is a plain string. See sel::Key.
+    int ref;
+
+    // Pushes t[key] where t is the table on top of the stack
+    void Get(lua_State *l) const {
+        if (field == nullptr) {
+            lua_pushinteger(l, index);
+            lua_gettable(l, -2);
+        } else if (ref != LUA_NOREF) {
+            lua_rawgeti(l, LUA_REGISTRYINDEX, ref);
+            lua_gettable(l, -2);
+        } else {
+            lua_getfield(l, -1, field);
+        }
+    }
+
+    // Performs t[key] = v where v is on top of the stack and t is just
+    // below it. Pops v.
+    void Set(lua_State *l) const {
+        if (field == nullptr) {
+            lua_pushinteger(l, index);
+            lua_insert(l, -2);
+            lua_settable(l, -3);
+        } else if (ref != LUA_NOREF) {
+            lua_rawgeti(l, LUA_REGISTRYINDEX, ref);
+            lua_insert(l, -2);
+            lua_settable(l, -3);
+        } else {
+            lua_setfield(l, -2, field);
+        }
+    }
+};
+
+/*
+ * Sequence of keys leading from a global to an element. Paths of
+ * typical depth are stored inline so building one does not touch the
+ * heap.
+ */
+class Path {
+private:
+    static constexpr std::size_t _inline_capacity = 8;
+    PathKey _keys[_inline_capacity];
+    std::vector<PathKey> _overflow;
+    std::size_t _size;
+
+public:
+    Path(const char *global) : _size(1) {
+        _keys[0] = PathKey{global, 0, LUA_NOREF};
+    }
+
+    void Push(PathKey key) {
+        if (_size < _inline_capacity) {
+            _keys[_size] = key;
+        } else {
+            _overflow.push_back(key);
+        }
+        ++_size;
+    }
+
+    std::size_t Size() const {
+        return _size;
+    }
+
+    const PathKey &operator[](std::size_t i) const {
+        return i < _inline_capacity ? _keys[i]
+                                    : _overflow[i - _inline_capacity];
+    }
+
+    const PathKey &Back() const {
+        return (*this)[_size - 1];
+    }
+
+    // Dotted representation, e.g. "my_table.nested.2"
+    std::string ToString() const {
+        std::string name{_keys[0].field};
+        for (std::size_t i = 1; i < _size; ++i) {
+            const PathKey &key = (*this)[i];
+            name += ".";
+            name += key.field == nullptr ? std::to_string(key.index)
+                                         : std::string{key.field};
+        }
+        return name;
+    }
+};
+}
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include "Hook.h"
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace sel {
+/*
+ * Samples the Lua call stack of a state from its count hook, which
+ * runs every CountHook::Period VM instructions and only reads the
+ * clock; a sample is taken when at least Interval() passed since the
+ * last one. Samples are aggregated by stack, the innermost frame being the
+ * line that was executing, and written in the collapsed format read
+ * by flamegraph.pl and compatible tools:
+ *
+ *   main chunk (test.lua:0);loop (test.lua:3);test.lua:5 42
+ *
+ * Coroutines acquired from the state's CoroutinePool while the
+ * profiler runs are sampled too, with the stack of the coroutine
+ * only. C functions do not execute VM instructions and only show up
+ * as callers.
+ *
+ * Installing the hook slows scripts down, by up to 20% until Lua 5.3
+ * and up to twice on 5.4, which checks for it at every instruction.
+ * With LuaJIT the JIT compiler is off while the hook is installed, so
+ * samples describe the interpreter rather than compiled code.
+ */
+class Profiler : public detail::CountHook::Client {
+private:
+    using Clock = std::chrono::steady_clock;
+
+    detail::CountHook *_hook;
+    Clock::duration _interval;
+    Clock::time_point _next;
+    std::size_t _samples;
+    std::unordered_map<std::string, std::size_t> _stacks;
+    std::vector<std::string> _frames;
+
+    static constexpr int _max_depth = 64;
+
+    void OnCount(lua_State *l) override {
+        const Clock::time_point now = Clock::now();
+        if (now < _next) return;
+        _next = now + _interval;
+        _sample(l);
+    }
+
+    static std::string _frame_name(const lua_Debug &ar) {
+        std::string frame;
+        if (ar.name != nullptr) {
+            frame = ar.name;
+        } else if (std::strcmp(ar.what, "main") == 0) {
+            frame = "main chunk";
+        } else {
+            frame = "anonymous";
+        }
+        if (std::strcmp(ar.what, "C") == 0) {
+            frame += " [C]";
+        } else {
+            frame += " (";
+            frame += ar.short_src;
+            frame += ":" + std::to_string(ar.linedefined) + ")";
+        }
+        return frame;
+    }
+
+    // ';' separates frames in the collapsed format
+    static void _escape(std::string &frame) {
+        for (char &c : frame) {
+            if (c == ';') c = ',';
+        }
+    }
+
+    void _sample(lua_State *l) {
+        lua_Debug ar;
+        _frames.clear();
+        for (int level = 0; level < _max_depth &&
+                 lua_getstack(l, level, &ar) == 1; ++level) {
+            lua_getinfo(l, "Snl", &ar);
+            if (level == 0 && ar.currentline > 0) {
+                _frames.push_back(std::string{ar.short_src} + ":" +
+                                  std::to_string(ar.currentline));
+            }
+            _frames.push_back(_frame_name(ar));
+        }
+        if (_frames.empty()) return;
+        std::string stack;
+        for (auto it = _frames.rbegin(); it != _frames.rend(); ++it) {
+            if (!stack.empty()) stack += ';';
+            _escape(*it);
+            stack += *it;
+        }
+        ++_stacks[stack];
+        ++_samples;
+    }
+
+public:
+    Profiler(detail::CountHook &hook, std::chrono::microseconds interval)
+        : _hook(&hook), _interval(interval),
+          _next(Clock::now() + _interval), _samples(0) {
+        _hook->Set(detail::CountHook::Profiling, this);
+    }
+    Profiler(const Profiler &) = delete;
+    Profiler &operator=(const Profiler &) = delete;
+    ~Profiler() {
+        Stop();
+    }
+
+    // Stops sampling and keeps the samples taken so far. Must be
+    // called before the state is closed.
+    void Stop() {
+        if (_hook == nullptr) return;
+        _hook->Set(detail::CountHook::Profiling, nullptr);
+        _hook = nullptr;
+    }
+
+    bool Running() const {
+        return _hook != nullptr;
+    }
+
+    std::chrono::microseconds Interval() const {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            _interval);
+    }
+
+    std::size_t Samples() const {
+        return _samples;
+    }
+
+    // Number of samples per collapsed stack
+    const std::unordered_map<std::string, std::size_t> &Stacks() const {
+        return _stacks;
+    }
+
+    // Writes one "frame;frame;... count" line per stack
+    void Write(std::ostream &os) const {
+        for (auto &stack : _stacks) {
+            os << stack.first << ' ' << stack.second << '\n';
+        }
+    }
+
+    void Reset() {
+        _stacks.clear();
+        _samples = 0;
+    }
+};
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "exotics.h"
+#include <limits>
+#include <string>
+#include "Table.h"
+#include <tuple>
+#include <vector>
+
+namespace sel {
+/*
+ * A precompiled batch of reads. Each path is a dotted string such as
+ * "cfg.net.3" where all-digit segments that fit in an int are integer
+ * indices, and other segments are field names. Paths are merged into a
+ * tree at construction so a table shared by several paths is looked up
+ * only once per execution; the same path may appear more than once.
+ * Missing elements read as nil.
+ */
+template <typename... T>
+class Query {
+private:
+    struct Node {
+        std::string field;
+        int index;
+        bool is_index;
+        // Positions of this node's value in the result
+        std::vector<int> slots;
+        std::vector<Node> children;
+    };
+    std::vector<Node> _roots;
+    int _lookups;
+    int _depth;
+
+    // Parses key as an index, false if it is a field name
+    static bool _parse_index(const std::string &key, int &index) {
+        if (key.empty()) return false;
+        const int max = std::numeric_limits<int>::max();
+        index = 0;
+        for (char c : key) {
+            if (c < '0' || c > '9') return false;
+            const int digit = c - '0';
+            if (index > (max - digit) / 10) return false;
+            index = index * 10 + digit;
+        }
+        return true;
+    }
+
+    static Node *_child(std::vector<Node> &nodes, const std::string &key) {
+        int index;
+        const bool is_index = _parse_index(key, index);
+        if (!is_index) index = 0;
+        for (auto &node : nodes) {
+            if (node.is_index == is_index &&
+                (is_index ? node.index == index : node.field == key)) {
+                return &node;
+            }
+        }
+        nodes.push_back(Node{is_index ? std::string{} : key, index,
+                    is_index, {}, {}});
+        return &nodes.back();
+    }
+
+    void _add(const std::string &path, const int slot) {
+        std::vector<Node> *nodes = &_roots;
+        Node *node = nullptr;
+        std::size_t start = 0;
+        int depth = 0;
+        while (true) {
+            const std::size_t end = path.find('.', start);
+            node = _child(*nodes, path.substr(start, end - start));
+            nodes = &node->children;
+            ++depth;
+            if (end == std::string::npos) break;
+            start = end + 1;
+        }
+        node->slots.push_back(slot);
+        if (depth > _depth) _depth = depth;
+    }
+
+    static int _count(const std::vector<Node> &nodes) {
+        int count = 0;
+        for (const auto &node : nodes) {
+            count += 1 + _count(node.children);
+        }
+        return count;
+    }
+
+    // The value of node is on top of the stack
+    static void _visit(lua_State *l, const Node &node, const int base) {
+        for (const int slot : node.slots) {
+            lua_pushvalue(l, -1);
+            lua_replace(l, base + slot);
+        }
+        const int type = lua_type(l, -1);
+        if (type != LUA_TTABLE && type != LUA_TUSERDATA) return;
+        for (const auto &child : node.children) {
+            if (child.is_index) {
+                lua_pushinteger(l, child.index);
+                lua_gettable(l, -2);
+            } else {
+                lua_getfield(l, -1, child.field.c_str());
+            }
+            _visit(l, child, base);
+            lua_pop(l, 1);
+        }
+    }
+
+    template <std::size_t... N>
+    static std::tuple<T...> _collect(lua_State *l, const int base,
+                                     detail::_indices<N...>) {
+        return std::tuple<T...>{
+            detail::_get(detail::_id<T>{}, l, base + int(N))...};
+    }
+
+public:
+    template <typename... Paths>
+    Query(Paths... paths) : _lookups(0), _depth(0) {
+        static_assert(sizeof...(Paths) == sizeof...(T),
+                      "A Query needs one path per result type.");
+        const char *list[] = {paths...};
+        for (std::size_t i = 0; i < sizeof...(T); ++i) {
+            _add(list[i], int(i));
+        }
+        _lookups = _count(_roots);
+    }
+
+    // Number of table lookups made by one execution
+    int Lookups() const {
+        return _lookups;
+    }
+
+    std::tuple<T...> Execute(lua_State *l) const {
+        constexpr int num_results = sizeof...(T);
+        luaL_checkstack(l, num_results + _depth + 1, "sel::Query");
+        const int base = lua_gettop(l) + 1;
+        for (int i = 0; i < num_results; ++i) {
+            lua_pushnil(l);
+        }
+        for (const auto &root : _roots) {
+            lua_getglobal(l, root.field.c_str());
+            _visit(l, root, base);
+            lua_pop(l, 1);
+        }
+        auto ret = _collect(l, base,
+                            typename detail::_indices_builder<sizeof...(T)>::type());
+        lua_settop(l, base - 1);
+        return ret;
+    }
+};
+}
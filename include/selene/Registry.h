@@ -1,9 +1,13 @@
 #pragma once
 
+#include "BindingStats.h"
 #include "Class.h"
 #include "exotics.h"
 #include "Fun.h"
+#include <map>
 #include "Obj.h"
+#include "Path.h"
+#include <string>
 #include <vector>
 
 namespace sel {
@@ -23,9 +27,52 @@ private:
     std::vector<std::unique_ptr<BaseObj>> _objs;
     std::vector<std::unique_ptr<BaseClass>> _classes;
     lua_State *_state;
+    // Per binding name, filled with SELENE_BINDING_STATS only
+    std::map<std::string, BindingStats> _stats;
+
+#ifdef SELENE_BINDING_STATS
+    // Attaches stats to the value at index if it is a bound function
+    void _track(int index, const std::string &name) {
+        if (lua_tocfunction(_state, index) != &detail::_lua_dispatcher) {
+            return;
+        }
+        lua_getupvalue(_state, index, 1);
+        auto fun = static_cast<BaseFun *>(lua_touserdata(_state, -1));
+        lua_pop(_state, 1);
+        if (fun != nullptr) fun->stats = &_stats[name];
+    }
+#endif
+
 public:
     Registry(lua_State *state) : _state(state) {}
 
+    // Names the binding on top of the stack after path for
+    // BindingStats: a function, or the functions of an object or class
+    // table, named path.field. Does nothing without
+    // SELENE_BINDING_STATS.
+    void Track(const detail::Path &path) {
+#ifdef SELENE_BINDING_STATS
+        const std::string name = path.ToString();
+        if (!lua_istable(_state, -1)) {
+            _track(-1, name);
+            return;
+        }
+        lua_pushnil(_state);
+        while (lua_next(_state, -2) != 0) {
+            if (lua_type(_state, -2) == LUA_TSTRING) {
+                _track(-1, name + "." + lua_tostring(_state, -2));
+            }
+            lua_pop(_state, 1);
+        }
+#else
+        (void)path;
+#endif
+    }
+
+    const std::map<std::string, BindingStats> &Stats() const {
+        return _stats;
+    }
+
     template <typename L>
     void Register(L lambda) {
         Register((typename detail::lambda_traits<L>::Fun)(lambda));
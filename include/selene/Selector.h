@@ -1,11 +1,18 @@
 #pragma once
 
+#include "BoundSelector.h"
+#include "Budget.h"
+#include <cstdint>
 #include "exotics.h"
 #include <functional>
+#include "Key.h"
+#include "Path.h"
 #include "Registry.h"
 #include <string>
+#include "Table.h"
+#include "TableBuilder.h"
 #include <tuple>
-#include <vector>
+#include "util.h"
 
 namespace sel {
 class State;
@@ -14,57 +21,118 @@ class Selector {
 private:
     lua_State *_state;
     Registry &_registry;
-    std::string _name;
-    using Fun = std::function<void()>;
-    using PFun = std::function<void(Fun)>;
 
-    // Traverses the structure up to this element
-    std::vector<Fun> _traversal;
-
-    // Pushes this element to the stack
-    Fun _get;
-    // Sets this element from a function that pushes a value to the
-    // stack.
-    PFun _put;
+    // Keys leading from a global to this element
+    detail::Path _path;
 
     // Functor is stored when the () operator is invoked. The argument
     // is used to indicate how many return values are expected
     using Functor = std::function<void(int)>;
     mutable std::unique_ptr<Functor> _functor;
 
-    Selector(lua_State *s, Registry &r, const std::string &name,
-             std::vector<Fun> traversal, Fun get, PFun put)
-        : _state(s), _registry(r), _name(name), _traversal{traversal},
-          _get(get), _put(put), _functor{nullptr} {}
+    Selector(lua_State *s, Registry &r, const detail::Path &path)
+        : _state(s), _registry(r), _path(path), _functor{nullptr} {}
 
     Selector(lua_State *s, Registry &r, const char *name)
-        : _state(s), _registry(r), _name(name), _functor{nullptr} {
-        _get = [this, name]() {
-            lua_getglobal(_state, name);
-        };
-        _put = [this, name](Fun fun) {
-            fun();
-            lua_setglobal(_state, name);
-        };
+        : _state(s), _registry(r), _path(name), _functor{nullptr} {}
+
+    // True if the value at index can be looked into with a key
+    bool _indexable(int index) const {
+        const int type = lua_type(_state, index);
+        return type == LUA_TTABLE || type == LUA_TUSERDATA;
     }
 
-    void _check_create_table() const {
-        _traverse();
-        _get();
-        if (lua_istable(_state, -1) == 0 ) { // not table
-            lua_pop(_state, 1); // flush the stack
-            auto put = [this]() {
+    // Pushes the table that owns this element to the stack. Nothing
+    // is pushed for a global. If the path runs into a missing table,
+    // the value where it stopped is pushed instead.
+    void _traverse() const {
+        const std::size_t depth = _path.Size();
+        if (depth < 2) return;
+        lua_getglobal(_state, _path[0].field);
+        for (std::size_t i = 1; i + 1 < depth && _indexable(-1); ++i) {
+            _path[i].Get(_state);
+            lua_replace(_state, -2);
+        }
+    }
+
+    // Same as _traverse() but replaces anything along the path that
+    // is not a table with a new table. Used before assignments.
+    void _traverse_create() const {
+        const std::size_t depth = _path.Size();
+        if (depth < 2) return;
+        lua_getglobal(_state, _path[0].field);
+        if (!lua_istable(_state, -1)) {
+            lua_pop(_state, 1);
+            lua_newtable(_state);
+            lua_pushvalue(_state, -1);
+            lua_setglobal(_state, _path[0].field);
+        }
+        for (std::size_t i = 1; i + 1 < depth; ++i) {
+            _path[i].Get(_state);
+            if (!lua_istable(_state, -1)) {
+                lua_pop(_state, 1);
                 lua_newtable(_state);
-            };
-            _put(put);
+                lua_pushvalue(_state, -1);
+                lua_insert(_state, -3);
+                _path[i].Set(_state);
+                lua_pop(_state, 1);
+            } else {
+                lua_replace(_state, -2);
+            }
+        }
+    }
+
+    // Pushes this element to the stack. Expects _traverse() to have
+    // been called.
+    void _get() const {
+        if (_path.Size() == 1) {
+            lua_getglobal(_state, _path[0].field);
+        } else if (_indexable(-1)) {
+            _path.Back().Get(_state);
+        } else {
+            lua_pushnil(_state);
+        }
+    }
+
+    // Sets this element to the value on top of the stack. Expects
+    // _traverse_create() to have been called before the value was
+    // pushed.
+    void _put() const {
+        if (_path.Size() == 1) {
+            lua_setglobal(_state, _path[0].field);
         } else {
+            _path.Back().Set(_state);
             lua_pop(_state, 1);
         }
     }
 
-    void _traverse() const {
-        for (auto &fun : _traversal) {
-            fun();
+    template <typename T>
+    T _read() const {
+        detail::ResetStackOnScopeExit save(_state);
+        _traverse();
+        _get();
+        if (_functor != nullptr) {
+            (*_functor)(1);
+            _functor.reset();
+        }
+        auto ret = detail::_pop(detail::_id<T>{}, _state);
+        return ret;
+    }
+
+    template <typename T>
+    void _assign(const T &value) const {
+        detail::ResetStackOnScopeExit save(_state);
+        _traverse_create();
+        detail::_push(_state, value);
+        _put();
+    }
+
+    // Pushes the table that owns this element to the stack
+    void _traverse_parent() const {
+        if (_path.Size() == 1) {
+            detail::_push_globals(_state);
+        } else {
+            _traverse_create();
         }
     }
 public:
@@ -72,19 +140,21 @@ public:
     Selector(const Selector &other)
         : _state(other._state),
           _registry(other._registry),
-          _name{other._name},
-        _traversal{other._traversal},
-        _get{other._get},
-        _put{other._put} {}
+          _path(other._path),
+          _functor{nullptr} {}
 
     ~Selector() {
         // If there is a functor present, execute it and collect no args
         if (_functor != nullptr) {
+            detail::ResetStackOnScopeExit save(_state);
             _traverse();
             _get();
-            (*_functor)(0);
+            try {
+                (*_functor)(0);
+            } catch (const BudgetExceeded &) {
+                // Reported by State::LastOverrun
+            }
         }
-        lua_settop(_state, 0);
     }
 
     // Allow automatic casting when used in comparisons
@@ -96,289 +166,298 @@ public:
         constexpr int num_args = sizeof...(Args);
         auto tmp = new Functor([this, tuple_args, num_args](int num_ret) {
                 detail::_push(_state, tuple_args);
-                lua_call(_state, num_args, num_ret);
+                detail::BudgetScope budget(_state);
+                budget.Call(num_args, num_ret);
             });
         _functor.reset(std::move(tmp));
         return *this;
     }
 
+    // Calls this element with args and returns its results right
+    // away: nothing for no Ret, a Ret for one and a std::tuple<Ret...>
+    // otherwise. Unlike operator() nothing is allocated or deferred.
+    template <typename... Ret, typename... Args>
+    typename detail::_pop_n_impl<sizeof...(Ret), Ret...>::type
+    Call(Args&&... args) const {
+        detail::ResetStackOnScopeExit save(_state);
+        _traverse();
+        _get();
+        detail::_push_refs(_state, args...);
+        detail::BudgetScope budget(_state);
+        budget.Call(sizeof...(Args), sizeof...(Ret));
+        return detail::_pop_n<Ret...>(_state);
+    }
+
     template <typename L>
     void operator=(L lambda) const {
-        _traverse();
-        auto push = [this, lambda]() {
-            _registry.Register(lambda);
-        };
-        _put(push);
-        lua_settop(_state, 0);
+        detail::ResetStackOnScopeExit save(_state);
+        _traverse_create();
+        _registry.Register(lambda);
+        _registry.Track(_path);
+        _put();
     }
 
 
     void operator=(bool b) const {
-        _traverse();
-        auto push = [this, b]() {
-            detail::_push(_state, b);
-        };
-        _put(push);
-        lua_settop(_state, 0);
+        detail::ResetStackOnScopeExit save(_state);
+        _traverse_create();
+        detail::_push(_state, b);
+        _put();
     }
 
     void operator=(int i) const {
-        _traverse();
-        auto push = [this, i]() {
-            detail::_push(_state, i);
-        };
-        _put(push);
-        lua_settop(_state, 0);
+        detail::ResetStackOnScopeExit save(_state);
+        _traverse_create();
+        detail::_push(_state, i);
+        _put();
     }
 
     void operator=(unsigned int i) const {
-        _traverse();
-        auto push = [this, i]() {
-            detail::_push(_state, i);
-        };
-        _put(push);
-        lua_settop(_state, 0);
+        detail::ResetStackOnScopeExit save(_state);
+        _traverse_create();
+        detail::_push(_state, i);
+        _put();
+    }
+
+    void operator=(std::int64_t i) const {
+        detail::ResetStackOnScopeExit save(_state);
+        _traverse_create();
+        detail::_push(_state, i);
+        _put();
+    }
+
+    void operator=(std::uint64_t i) const {
+        detail::ResetStackOnScopeExit save(_state);
+        _traverse_create();
+        detail::_push(_state, i);
+        _put();
     }
 
     void operator=(lua_Number n) const {
-        _traverse();
-        auto push = [this, n]() {
-            detail::_push(_state, n);
-        };
-        _put(push);
-        lua_settop(_state, 0);
+        detail::ResetStackOnScopeExit save(_state);
+        _traverse_create();
+        detail::_push(_state, n);
+        _put();
     }
 
     void operator=(const std::string &s) const {
-        _traverse();
-        auto push = [this, s]() {
-            detail::_push(_state, s);
-        };
-        _put(push);
-        lua_settop(_state, 0);
+        detail::ResetStackOnScopeExit save(_state);
+        _traverse_create();
+        detail::_push(_state, s);
+        _put();
     }
 
     template <typename Ret, typename... Args>
     void operator=(std::function<Ret(Args...)> fun) {
-        _traverse();
-        auto push = [this, fun]() {
-            _registry.Register(fun);
-        };
-        _put(push);
+        detail::ResetStackOnScopeExit save(_state);
+        _traverse_create();
+        _registry.Register(fun);
+        _registry.Track(_path);
+        _put();
     }
 
     template <typename Ret, typename... Args>
     void operator=(Ret (*fun)(Args...)) {
-        _traverse();
-        auto push = [this, fun]() {
-            _registry.Register(fun);
-        };
-        _put(push);
+        detail::ResetStackOnScopeExit save(_state);
+        _traverse_create();
+        _registry.Register(fun);
+        _registry.Track(_path);
+        _put();
+    }
+
+    // A function bound with sel::bind, pushed without a Registry entry
+    void operator=(CFunction fun) const {
+        detail::ResetStackOnScopeExit save(_state);
+        _traverse_create();
+        detail::_push(_state, fun);
+        _put();
     }
 
     void operator=(const char *s) const {
-        _traverse();
-        auto push = [this, s]() {
-            detail::_push(_state, std::string{s});
-        };
-        _put(push);
-        lua_settop(_state, 0);
+        detail::ResetStackOnScopeExit save(_state);
+        _traverse_create();
+        detail::_push(_state, s);
+        _put();
+    }
+
+    template <typename T>
+    void operator=(const std::vector<T> &values) const {
+        _assign(values);
+    }
+
+    template <typename T, std::size_t N>
+    void operator=(const std::array<T, N> &values) const {
+        _assign(values);
+    }
+
+    template <typename K, typename V>
+    void operator=(const std::map<K, V> &values) const {
+        _assign(values);
+    }
+
+    template <typename K, typename V>
+    void operator=(const std::unordered_map<K, V> &values) const {
+        _assign(values);
+    }
+
+    // Assigns the table built by builder. The builder is spent
+    // afterwards.
+    void operator=(TableBuilder &builder) const {
+        {
+            detail::ResetStackOnScopeExit save(_state);
+            _traverse_create();
+            lua_pushvalue(_state, builder._index);
+            _put();
+        }
+        builder._release();
+    }
+
+    void operator=(TableBuilder &&builder) const {
+        *this = builder;
     }
 
     template <typename T, typename... Funs>
     void SetObj(T &t, Funs... funs) {
-        _traverse();
+        detail::ResetStackOnScopeExit save(_state);
+        _traverse_create();
         auto fun_tuple = std::make_tuple(funs...);
-        auto push = [this, &t, &fun_tuple]() {
-            _registry.Register(t, fun_tuple);
-        };
-        _put(push);
-        lua_settop(_state, 0);
+        _registry.Register(t, fun_tuple);
+        _registry.Track(_path);
+        _put();
     }
 
     template <typename T, typename... Args, typename... Funs>
     void SetClass(Funs... funs) {
-        _traverse();
+        detail::ResetStackOnScopeExit save(_state);
+        _traverse_create();
         auto fun_tuple = std::make_tuple(funs...);
-        auto push = [this, &fun_tuple]() {
-            typename detail::_indices_builder<sizeof...(Funs)>::type d;
-            _registry.RegisterClass<T, Args...>(_name, fun_tuple, d);
-        };
-        _put(push);
-        lua_settop(_state, 0);
+        typename detail::_indices_builder<sizeof...(Funs)>::type d;
+        _registry.RegisterClass<T, Args...>(_path.ToString(), fun_tuple, d);
+        _registry.Track(_path);
+        _put();
+    }
+
+    // Resolves the path to this element once, creating missing tables
+    // along the way. The returned BoundSelector reads and writes the
+    // element with a single table lookup for as long as it lives. It
+    // copies the field name, and does not use the registry slot of a
+    // Key, which may be released first.
+    BoundSelector Pin() const {
+        detail::ResetStackOnScopeExit save(_state);
+        _traverse_parent();
+        LuaRef parent{_state, luaL_ref(_state, LUA_REGISTRYINDEX)};
+        const detail::PathKey &key = _path.Back();
+        if (key.field == nullptr) {
+            return BoundSelector{_state, parent, key.index};
+        }
+        return BoundSelector{_state, parent, key.field};
     }
 
     template <typename... Ret>
     std::tuple<Ret...> GetTuple() const {
+        detail::ResetStackOnScopeExit save(_state);
         _traverse();
         _get();
         (*_functor)(sizeof...(Ret));
-        return detail::_pop_n_reset<Ret...>(_state);
+        return detail::_pop_n<Ret...>(_state);
     }
 
     template <typename T>
     operator T&() const {
-        _traverse();
-        _get();
-        if (_functor != nullptr) {
-            (*_functor)(1);
-            _functor.reset();
-        }
-        auto ret = detail::_pop(detail::_id<T*>{}, _state);
-        lua_settop(_state, 0);
-        return *ret;
+        return *_read<T*>();
     }
 
     template <typename T>
     operator T*() const {
-        _traverse();
-        _get();
-        if (_functor != nullptr) {
-            (*_functor)(1);
-            _functor.reset();
-        }
-        auto ret = detail::_pop(detail::_id<T*>{}, _state);
-        lua_settop(_state, 0);
-        return ret;
+        return _read<T*>();
     }
 
     operator bool() const {
-        _traverse();
-        _get();
-        if (_functor != nullptr) {
-            (*_functor)(1);
-            _functor.reset();
-        }
-        auto ret = detail::_pop(detail::_id<bool>{}, _state);
-        lua_settop(_state, 0);
-        return ret;
+        return _read<bool>();
     }
 
     operator int() const {
-        _traverse();
-        _get();
-        if (_functor != nullptr) {
-            (*_functor)(1);
-            _functor.reset();
-        }
-        auto ret = detail::_pop(detail::_id<int>{}, _state);
-        lua_settop(_state, 0);
-        return ret;
+        return _read<int>();
     }
 
     operator unsigned int() const {
-        _traverse();
-        _get();
-        if (_functor != nullptr) {
-            (*_functor)(1);
-            _functor.reset();
-        }
-        auto ret = detail::_pop(detail::_id<unsigned int>{}, _state);
-        lua_settop(_state, 0);
-        return ret;
+        return _read<unsigned int>();
+    }
+
+    operator std::int64_t() const {
+        return _read<std::int64_t>();
+    }
+
+    operator std::uint64_t() const {
+        return _read<std::uint64_t>();
     }
 
     operator lua_Number() const {
-        _traverse();
-        _get();
-        if (_functor != nullptr) {
-            (*_functor)(1);
-            _functor.reset();
-        }
-        auto ret = detail::_pop(detail::_id<lua_Number>{}, _state);
-        lua_settop(_state, 0);
-        return ret;
+        return _read<lua_Number>();
     }
 
     operator std::string() const {
-        _traverse();
-        _get();
-        if (_functor != nullptr) {
-            (*_functor)(1);
-            _functor.reset();
-        }
-        auto ret =  detail::_pop(detail::_id<std::string>{}, _state);
-        lua_settop(_state, 0);
-        return ret;
+        return _read<std::string>();
+    }
+
+    operator Table() const {
+        return _read<Table>();
+    }
+
+    template <typename T>
+    operator std::vector<T>() const {
+        return _read<std::vector<T>>();
+    }
+
+    template <typename T, std::size_t N>
+    operator std::array<T, N>() const {
+        return _read<std::array<T, N>>();
+    }
+
+    template <typename K, typename V>
+    operator std::map<K, V>() const {
+        return _read<std::map<K, V>>();
+    }
+
+    template <typename K, typename V>
+    operator std::unordered_map<K, V>() const {
+        return _read<std::unordered_map<K, V>>();
     }
 
     template <typename R, typename... Args>
     operator sel::function<R(Args...)>() {
-        _traverse();
-        _get();
-        if (_functor != nullptr) {
-            (*_functor)(1);
-            _functor.reset();
-        }
-        auto ret = detail::_pop(detail::_id<sel::function<R(Args...)>>{},
-                                _state);
-        lua_settop(_state, 0);
-        return ret;
+        return _read<sel::function<R(Args...)>>();
     }
 
     // Chaining operators. If the selector is an rvalue, modify in
     // place. Otherwise, create a new Selector and return it.
     Selector&& operator[](const char *name) && {
-        _name += std::string(".") + name;
-        _check_create_table();
-        _traversal.push_back(_get);
-        _get = [this, name]() {
-            lua_getfield(_state, -1, name);
-        };
-        _put = [this, name](Fun fun) {
-            fun();
-            lua_setfield(_state, -2, name);
-            lua_pop(_state, 1);
-        };
+        _path.Push(detail::PathKey{name, 0, LUA_NOREF});
         return std::move(*this);
     }
     Selector&& operator[](const int index) && {
-        _name += std::string(".") + std::to_string(index);
-        _check_create_table();
-        _traversal.push_back(_get);
-        _get = [this, index]() {
-            lua_pushinteger(_state, index);
-            lua_gettable(_state, -2);
-        };
-        _put = [this, index](Fun fun) {
-            lua_pushinteger(_state, index);
-            fun();
-            lua_settable(_state, -3);
-            lua_pop(_state, 1);
-        };
+        _path.Push(detail::PathKey{nullptr, index, LUA_NOREF});
+        return std::move(*this);
+    }
+    Selector&& operator[](const Key &key) && {
+        _path.Push(detail::PathKey{key.Name().c_str(), 0, key.Id()});
         return std::move(*this);
     }
     Selector operator[](const char *name) const & {
-        auto n = _name + "." + name;
-        _check_create_table();
-        auto traversal = _traversal;
-        traversal.push_back(_get);
-        Fun get = [this, name]() {
-            lua_getfield(_state, -1, name);
-        };
-        PFun put = [this, name](Fun fun) {
-            fun();
-            lua_setfield(_state, -2, name);
-            lua_pop(_state, 1);
-        };
-        return Selector{_state, _registry, n, traversal, get, put};
+        detail::Path path = _path;
+        path.Push(detail::PathKey{name, 0, LUA_NOREF});
+        return Selector{_state, _registry, path};
     }
     Selector operator[](const int index) const & {
-        auto name = _name + "." + std::to_string(index);
-        _check_create_table();
-        auto traversal = _traversal;
-        traversal.push_back(_get);
-        Fun get = [this, index]() {
-            lua_pushinteger(_state, index);
-            lua_gettable(_state, -2);
-        };
-        PFun put = [this, index](Fun fun) {
-            lua_pushinteger(_state, index);
-            fun();
-            lua_settable(_state, -3);
-            lua_pop(_state, 1);
-        };
-        return Selector{_state, _registry, name, traversal, get, put};
+        detail::Path path = _path;
+        path.Push(detail::PathKey{nullptr, index, LUA_NOREF});
+        return Selector{_state, _registry, path};
+    }
+
+    Selector operator[](const Key &key) const & {
+        detail::Path path = _path;
+        path.Push(detail::PathKey{key.Name().c_str(), 0, key.Id()});
+        return Selector{_state, _registry, path};
     }
 
     friend bool operator==(const Selector &, const char *);
@@ -387,15 +466,7 @@ public:
 
 private:
     std::string ToString() const {
-        _traverse();
-        _get();
-        if (_functor != nullptr) {
-            (*_functor)(1);
-            _functor.reset();
-        }
-        auto ret =  detail::_pop(detail::_id<std::string>{}, _state);
-        lua_settop(_state, 0);
-        return ret;
+        return _read<std::string>();
     }
 };
 
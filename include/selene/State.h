@@ -1,7 +1,19 @@
 #pragma once
 
+#include "Allocator.h"
+#include "Budget.h"
+#include "BytecodeCache.h"
+#include <chrono>
+#include "Chunk.h"
+#include "ChunkCache.h"
+#include "Coroutine.h"
+#include "Hook.h"
 #include <iostream>
+#include <map>
+#include "MappedFile.h"
 #include <memory>
+#include "Profiler.h"
+#include "Query.h"
 #include <string>
 #include "Registry.h"
 #include "Selector.h"
@@ -10,21 +22,85 @@
 #include <vector>
 
 namespace sel {
+enum class GCMode {
+    Incremental,
+    // Only available in Lua 5.2 and 5.4
+    Generational
+};
+
 class State {
+    friend class EventLoop;
+    friend class StatePool;
 private:
     lua_State *_l;
     bool _l_owner;
     std::unique_ptr<Registry> _registry;
+    // Allocator policy of a state created with one. Destroyed after
+    // the state is closed.
+    std::shared_ptr<void> _allocator;
+    // Statistics kept by an AccountingAllocator, nullptr otherwise
+    sel::MemoryStats *_memory;
+    // Used by Load when set
+    std::unique_ptr<BytecodeCache> _bytecode_cache;
+    // Used by operator() when set
+    std::unique_ptr<ChunkCache> _chunk_cache;
+    // Threads for coroutines, created on first use
+    std::unique_ptr<CoroutinePool> _coroutines;
+    // Shared by the profiler and the budget, created on first use
+    std::unique_ptr<detail::CountHook> _hooks;
+    // Set by StartProfiler, kept after StopProfiler
+    std::unique_ptr<Profiler> _profiler;
+    // Set by SetBudget
+    std::unique_ptr<detail::Watchdog> _watchdog;
+
+    // Step multiplier for GCStepFor, the smallest Lua accepts. Lua 5.2
+    // and 5.3 raise it to 40.
+    static constexpr int _gc_small_stepmul = 1;
+
+    detail::CountHook &_count_hook() {
+        if (_hooks == nullptr) _hooks.reset(new detail::CountHook{_l});
+        return *_hooks;
+    }
+
+    // Removes the hook before the state is closed
+    void _release_hooks() {
+        StopProfiler();
+        _watchdog.reset();
+        _hooks.reset();
+    }
+
+    static int _panic(lua_State *l) {
+        const char *message = lua_tostring(l, -1);
+        std::cerr << "PANIC: unprotected error in call to Lua API ("
+                  << (message != nullptr ? message : "?") << ")"
+                  << std::endl;
+        return 0;
+    }
 
 public:
     State() : State(false) {}
-    State(bool should_open_libs) : _l(nullptr), _l_owner(true) {
+    State(bool should_open_libs)
+        : _l(nullptr), _l_owner(true), _memory(nullptr) {
         _l = luaL_newstate();
         if (_l == nullptr) throw 0;
         if (should_open_libs) luaL_openlibs(_l);
         _registry.reset(new Registry(_l));
     }
-    State(lua_State *l) : _l(l), _l_owner(false) {
+
+    // Creates a state whose memory is managed by allocator, e.g. a
+    // PoolAllocator. See Allocator.h for the policy interface.
+    template <typename Allocator>
+    State(std::unique_ptr<Allocator> allocator, bool should_open_libs = false)
+        : _l(nullptr), _l_owner(true), _allocator(std::move(allocator)),
+          _memory(detail::_memory_stats(
+                      static_cast<Allocator *>(_allocator.get()))) {
+        _l = lua_newstate(&detail::_lua_alloc<Allocator>, _allocator.get());
+        if (_l == nullptr) throw 0;
+        lua_atpanic(_l, &_panic);
+        if (should_open_libs) luaL_openlibs(_l);
+        _registry.reset(new Registry(_l));
+    }
+    State(lua_State *l) : _l(l), _l_owner(false), _memory(nullptr) {
         _registry.reset(new Registry(_l));
     }
     State(const State &other) = delete;
@@ -32,18 +108,39 @@ public:
     State(State &&other)
         : _l(other._l),
           _l_owner(other._l_owner),
-          _registry(std::move(other._registry)) {
+          _registry(std::move(other._registry)),
+          _allocator(std::move(other._allocator)),
+          _memory(other._memory),
+          _bytecode_cache(std::move(other._bytecode_cache)),
+          _chunk_cache(std::move(other._chunk_cache)),
+          _coroutines(std::move(other._coroutines)),
+          _hooks(std::move(other._hooks)),
+          _profiler(std::move(other._profiler)),
+          _watchdog(std::move(other._watchdog)) {
         other._l = nullptr;
     }
     State &operator=(State &&other) {
         if (&other == this) return *this;
+        _release_hooks();
+        if (_l != nullptr && _l_owner) {
+            lua_close(_l);
+        }
         _l = other._l;
         _l_owner = other._l_owner;
         _registry = std::move(other._registry);
+        _allocator = std::move(other._allocator);
+        _memory = other._memory;
+        _bytecode_cache = std::move(other._bytecode_cache);
+        _chunk_cache = std::move(other._chunk_cache);
+        _coroutines = std::move(other._coroutines);
+        _hooks = std::move(other._hooks);
+        _profiler = std::move(other._profiler);
+        _watchdog = std::move(other._watchdog);
         other._l = nullptr;
         return *this;
     }
     ~State() {
+        _release_hooks();
         if (_l != nullptr && _l_owner) {
             lua_close(_l);
         }
@@ -54,17 +151,99 @@ public:
         return lua_gettop(_l);
     }
 
+    // Memory statistics of a state created with an AccountingAllocator.
+    // For other states only live is set, from the garbage collector's
+    // count.
+    sel::MemoryStats MemoryStats() const {
+        if (_memory != nullptr) return *_memory;
+        const std::size_t live =
+            std::size_t(lua_gc(_l, LUA_GCCOUNT, 0)) * 1024 +
+            std::size_t(lua_gc(_l, LUA_GCCOUNTB, 0));
+        return sel::MemoryStats{live, 0, 0, 0, 0};
+    }
+
+    // Calls and latencies of the C++ functions, object and class
+    // methods assigned through selectors, by name. Empty unless Selene
+    // is built with SELENE_BINDING_STATS defined.
+    const std::map<std::string, sel::BindingStats> &BindingStats() const {
+        return _registry->Stats();
+    }
+
+    // Changes the limit of an AccountingAllocator, 0 for no limit.
+    // Returns false if the state does not have one.
+    bool SetMemoryLimit(std::size_t bytes) {
+        if (_memory == nullptr) return false;
+        _memory->limit = bytes;
+        return true;
+    }
+
     bool Load(const std::string &file) {
-        return !luaL_dofile(_l, file.c_str());
+        detail::ResetStackOnScopeExit save(_l);
+        detail::BudgetScope budget(_l);
+        if (_bytecode_cache == nullptr) {
+            return !luaL_dofile(_l, file.c_str());
+        }
+        return _bytecode_cache->LoadFile(_l, file) == 0 &&
+            lua_pcall(_l, 0, LUA_MULTRET, 0) == 0;
     }
 
+    // Runs the chunk held in the size bytes at data, which need not be
+    // NUL terminated, without copying it. chunkname is used in error
+    // messages and debug information, e.g. "=embedded" or "@file.lua".
+    bool LoadBuffer(const char *data, std::size_t size,
+                    const char *chunkname) {
+        detail::ResetStackOnScopeExit save(_l);
+        detail::BudgetScope budget(_l);
+        return luaL_loadbuffer(_l, data, size, chunkname) == 0 &&
+            lua_pcall(_l, 0, LUA_MULTRET, 0) == 0;
+    }
+
+    // Same as Load but parses the file straight from a memory mapping
+    // instead of reading it through a buffer
+    bool LoadMapped(const std::string &file) {
+        detail::MappedFile mapped{file};
+        if (!mapped) return false;
+        const char *data = mapped.Data();
+        std::size_t size = mapped.Size();
+        // Skip a leading #! line but keep its newline so line numbers
+        // stay correct
+        if (size > 0 && data[0] == '#') {
+            while (size > 0 && *data != '\n') {
+                ++data;
+                --size;
+            }
+        }
+        return LoadBuffer(data, size, ("@" + file).c_str());
+    }
+
+    // Makes Load keep compiled chunks in directory, which must exist.
+    // An empty directory turns the cache off. See BytecodeCache.
+    void SetBytecodeCache(const std::string &directory) {
+        _bytecode_cache.reset(directory.empty() ? nullptr
+                              : new BytecodeCache{directory});
+    }
+
+    // nullptr unless SetBytecodeCache was called
+    const BytecodeCache *GetBytecodeCache() const {
+        return _bytecode_cache.get();
+    }
+
+    // Opens a library as require would and sets the global modname
+    // to it
     void OpenLib(const std::string& modname, lua_CFunction openf) {
+        detail::ResetStackOnScopeExit save(_l);
 #if LUA_VERSION_NUM >= 502
         luaL_requiref(_l, modname.c_str(), openf, 1);
 #else
+        // What luaL_requiref does, which Lua 5.1 and LuaJIT lack
         lua_pushcfunction(_l, openf);
         lua_pushstring(_l, modname.c_str());
-        lua_call(_l, 1, 0);
+        lua_call(_l, 1, 1);
+        luaL_findtable(_l, LUA_REGISTRYINDEX, "_LOADED", 1);
+        lua_pushvalue(_l, -2);
+        lua_setfield(_l, -2, modname.c_str());
+        lua_pop(_l, 1);
+        lua_setglobal(_l, modname.c_str());
 #endif
     }
 
@@ -89,20 +268,199 @@ public:
         lua_pop(_l, 1);
         return result;
     }
+
+    // Reads several dotted paths at once, e.g.
+    // state.GetMany<int, std::string>("a", "b.c"). Prefer building a
+    // Query once when the same paths are read repeatedly.
+    template <typename... T, typename... Paths>
+    std::tuple<T...> GetMany(Paths... paths) {
+        return Query<T...>{paths...}.Execute(_l);
+    }
+
+    template <typename... T>
+    std::tuple<T...> GetMany(const Query<T...> &query) {
+        return query.Execute(_l);
+    }
 public:
     Selector operator[](const char *name) {
         return Selector(_l, *_registry, name);
     }
 
+    // Interns a field name for repeated access. See Key.
+    Key Intern(const std::string &name) {
+        return Key{_l, name};
+    }
+
+    // Starts building a table on the stack. See TableBuilder.
+    TableBuilder NewTable(int narr = 0, int nrec = 0) {
+        return TableBuilder{_l, narr, nrec};
+    }
+
     bool operator()(const char *code) {
-        bool result = !luaL_dostring(_l, code);
-        if(result) lua_settop(_l, 0);
-        return result;
+        detail::ResetStackOnScopeExit save(_l);
+        detail::BudgetScope budget(_l);
+        if (_chunk_cache == nullptr) {
+            return !luaL_dostring(_l, code);
+        }
+        return _chunk_cache->Load(_l, code) == 0 &&
+            lua_pcall(_l, 0, LUA_MULTRET, 0) == 0;
+    }
+
+    // Creates a coroutine that runs the function found at function,
+    // e.g. state.NewCoroutine(state["tasks"]["run"])
+    Coroutine NewCoroutine(const Selector &function) {
+        if (_coroutines == nullptr) {
+            _coroutines.reset(new CoroutinePool{_l});
+        }
+        detail::ResetStackOnScopeExit save(_l);
+        function._traverse();
+        function._get();
+        return Coroutine{_l, *_coroutines};
     }
+
+    // nullptr until the first coroutine is created
+    const CoroutinePool *GetCoroutinePool() const {
+        return _coroutines.get();
+    }
+
+    // Compiles code once for running it many times. Check the result
+    // for compilation errors.
+    Chunk Compile(const char *code) {
+        detail::ResetStackOnScopeExit save(_l);
+        if (luaL_loadstring(_l, code) != 0) {
+            return Chunk{_l, lua_tostring(_l, -1)};
+        }
+        return Chunk{_l};
+    }
+
+    // Makes operator() keep the functions compiled from the last
+    // capacity snippets it ran. A capacity of 0 turns the cache off.
+    void SetChunkCache(std::size_t capacity) {
+        if (_chunk_cache != nullptr) _chunk_cache->Clear(_l);
+        _chunk_cache.reset(capacity == 0 ? nullptr
+                           : new ChunkCache{capacity});
+    }
+
+    // nullptr unless SetChunkCache was called
+    const ChunkCache *GetChunkCache() const {
+        return _chunk_cache.get();
+    }
+
+    // Samples the Lua call stack about every interval, replacing the
+    // samples of an earlier run. See Profiler.
+    const Profiler &StartProfiler(
+        std::chrono::microseconds interval = std::chrono::milliseconds(1)) {
+        _profiler.reset();
+        _profiler.reset(new Profiler{_count_hook(), interval});
+        return *_profiler;
+    }
+
+    void StopProfiler() {
+        if (_profiler != nullptr) _profiler->Stop();
+    }
+
+    // nullptr unless StartProfiler was called. Its samples can be
+    // written with Write while it runs or after it stopped.
+    const Profiler *GetProfiler() const {
+        return _profiler.get();
+    }
+
+    // Limits each call from C++ into Lua, unless it is nested in
+    // another one, to budget. A call running out of it is aborted:
+    // calls returning a bool return false and the others throw
+    // BudgetExceeded. The state stays usable. Returns the previous
+    // budget; Budget{} removes the limits. See also ScopedBudget.
+    Budget SetBudget(const Budget &budget) {
+        if (_watchdog == nullptr) {
+            if (budget.Unlimited()) return Budget{};
+            _watchdog.reset(new detail::Watchdog{_count_hook()});
+        }
+        const Budget previous = _watchdog->GetBudget();
+        _watchdog->SetBudget(budget);
+        return previous;
+    }
+
+    Budget GetBudget() const {
+        return _watchdog != nullptr ? _watchdog->GetBudget() : Budget{};
+    }
+
+    // The limit the last budgeted call ran out of, if any
+    BudgetLimit LastOverrun() const {
+        return _watchdog != nullptr ? _watchdog->Overrun()
+            : BudgetLimit::None;
+    }
+
     void ForceGC() {
         lua_gc(_l, LUA_GCCOLLECT, 0);
     }
 
+    // Returns false if the Lua version does not support mode
+    bool SetGCMode(GCMode mode) {
+#if LUA_VERSION_NUM >= 504
+        // Zeros keep the current tuning parameters
+        if (mode == GCMode::Incremental) {
+            lua_gc(_l, LUA_GCINC, 0, 0, 0);
+        } else {
+            lua_gc(_l, LUA_GCGEN, 0, 0);
+        }
+        return true;
+#elif LUA_VERSION_NUM == 502
+        lua_gc(_l, mode == GCMode::Incremental ? LUA_GCINC : LUA_GCGEN, 0);
+        return true;
+#else
+        return mode == GCMode::Incremental;
+#endif
+    }
+
+    // Sets how long the collector waits before a new cycle, in
+    // percent of the memory in use after the last one. Returns the
+    // previous value. Lua 5.4 rounds it down to a multiple of 4.
+    int SetGCPause(int percent) {
+        return lua_gc(_l, LUA_GCSETPAUSE, percent);
+    }
+
+    // Sets how much work each incremental step does relative to
+    // allocation, in percent. Returns the previous value. Lua 5.4
+    // rounds it down to a multiple of 4.
+    int SetGCStepMul(int percent) {
+        return lua_gc(_l, LUA_GCSETSTEPMUL, percent);
+    }
+
+    // Stops automatic collection, e.g. around a critical section.
+    // Explicit steps and ForceGC still work.
+    void StopGC() {
+        lua_gc(_l, LUA_GCSTOP, 0);
+    }
+
+    void RestartGC() {
+        lua_gc(_l, LUA_GCRESTART, 0);
+    }
+
+    // Runs one step of the collector, as if kbytes had been allocated.
+    // Returns true if the step finished a cycle.
+    bool GCStep(int kbytes = 0) {
+        return lua_gc(_l, LUA_GCSTEP, kbytes) != 0;
+    }
+
+    // Runs collector steps until budget has elapsed or a cycle
+    // finishes, and returns true if a cycle finished. The step
+    // multiplier is lowered meanwhile so that each step does little
+    // work, but some parts of a cycle cannot be split and may overrun
+    // the budget: the atomic phase, freeing a run of dead objects
+    // with nothing alive after it, and on Lua 5.1 shrinking the string
+    // table.
+    bool GCStepFor(std::chrono::microseconds budget) {
+        using clock = std::chrono::steady_clock;
+        const auto deadline = clock::now() + budget;
+        const int stepmul = lua_gc(_l, LUA_GCSETSTEPMUL, _gc_small_stepmul);
+        bool finished;
+        do {
+            finished = GCStep();
+        } while (!finished && clock::now() < deadline);
+        lua_gc(_l, LUA_GCSETSTEPMUL, stepmul);
+        return finished;
+    }
+
     void InteractiveDebug() {
         luaL_dostring(_l, "debug.debug()");
     }
@@ -114,4 +472,24 @@ inline std::ostream &operator<<(std::ostream &os, const State &state) {
     os << "sel::State - " << state._l;
     return os;
 }
+
+/*
+ * Sets the budget of a state for the calls made during its lifetime,
+ * e.g. to give a single call its own limits, and restores the previous
+ * one afterwards
+ */
+class ScopedBudget {
+private:
+    State &_state;
+    Budget _previous;
+
+public:
+    ScopedBudget(State &state, const Budget &budget)
+        : _state(state), _previous(state.SetBudget(budget)) {}
+    ScopedBudget(const ScopedBudget &) = delete;
+    ScopedBudget &operator=(const ScopedBudget &) = delete;
+    ~ScopedBudget() {
+        _state.SetBudget(_previous);
+    }
+};
 }
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include "State.h"
+#include "util.h"
+#include <vector>
+
+namespace sel {
+/*
+ * A set of States prepared by the same init callback. Leases hand out
+ * a State for exclusive use and return it when they go out of scope.
+ * A returned State has its globals reset to what they were right
+ * after init: globals added since are removed and replaced ones are
+ * restored, along with the metatable of _G. Tables that are globals
+ * right after init, such as the standard libraries, and package.loaded
+ * have their fields reset the same way. Anything deeper is not reset:
+ * changes to tables nested in those, to metatables other than that of
+ * _G, to upvalues and to the registry persist across leases, so the
+ * pool does not isolate untrusted code of different tenants.
+ *
+ * Functions and classes should be registered by the init callback;
+ * bindings registered while a State is leased stay alive until the
+ * pool is destroyed. Acquire and release are thread safe. The pool
+ * must outlive its leases.
+ */
+class StatePool {
+private:
+    struct Entry {
+        std::unique_ptr<State> state;
+        // Registry references to a table mapping _G, the tables among
+        // its fields and package.loaded to copies of themselves, and to
+        // the metatable of _G
+        int tables;
+        int metatable;
+    };
+
+    std::function<void(State &)> _init;
+    bool _open_libs;
+    std::mutex _mutex;
+    std::vector<std::unique_ptr<Entry>> _entries;
+    std::vector<Entry *> _idle;
+
+    Entry *_create() {
+        std::unique_ptr<Entry> entry{new Entry{
+                std::unique_ptr<State>(new State{_open_libs}),
+                LUA_NOREF, LUA_NOREF}};
+        _init(*entry->state);
+        lua_State *l = entry->state->_l;
+        lua_settop(l, 0);
+        detail::_push_globals(l);
+        lua_newtable(l);
+        _snapshot(l, 1, 2);
+        lua_pushnil(l);
+        while (lua_next(l, 1) != 0) {
+            if (lua_istable(l, -1)) {
+                _snapshot(l, lua_gettop(l), 2);
+            }
+            lua_pop(l, 1);
+        }
+        lua_getfield(l, LUA_REGISTRYINDEX, "_LOADED");
+        if (lua_istable(l, -1)) _snapshot(l, lua_gettop(l), 2);
+        lua_pop(l, 1);
+        entry->tables = luaL_ref(l, LUA_REGISTRYINDEX);
+        if (!lua_getmetatable(l, 1)) lua_pushnil(l);
+        entry->metatable = luaL_ref(l, LUA_REGISTRYINDEX);
+        lua_settop(l, 0);
+        Entry *ret = entry.get();
+        std::lock_guard<std::mutex> lock{_mutex};
+        _entries.push_back(std::move(entry));
+        return ret;
+    }
+
+    // Stores a copy of the table at index in the map at index tables
+    static void _snapshot(lua_State *l, int index, int tables) {
+        lua_pushvalue(l, index);
+        lua_rawget(l, tables);
+        const bool seen = !lua_isnil(l, -1);
+        lua_pop(l, 1);
+        if (seen) return;
+        lua_pushvalue(l, index);
+        lua_newtable(l);
+        lua_pushnil(l);
+        while (lua_next(l, index) != 0) {
+            lua_pushvalue(l, -2);
+            lua_insert(l, -2);
+            lua_rawset(l, -4);
+        }
+        lua_rawset(l, tables);
+    }
+
+    // Makes the fields of the table at index those of the copy on top
+    // of the stack, then pops the copy
+    static void _restore(lua_State *l, int index) {
+        const int copy = lua_gettop(l);
+        // Clear fields missing from the copy. Assigning nil to existing
+        // fields is allowed during a traversal.
+        lua_pushnil(l);
+        while (lua_next(l, index) != 0) {
+            lua_pop(l, 1);
+            lua_pushvalue(l, -1);
+            lua_rawget(l, copy);
+            const bool added = lua_isnil(l, -1);
+            lua_pop(l, 1);
+            if (added) {
+                lua_pushvalue(l, -1);
+                lua_pushnil(l);
+                lua_rawset(l, index);
+            }
+        }
+        lua_pushnil(l);
+        while (lua_next(l, copy) != 0) {
+            lua_pushvalue(l, -2);
+            lua_insert(l, -2);
+            lua_rawset(l, index);
+        }
+        lua_pop(l, 1);
+    }
+
+    static void _reset(Entry *entry) {
+        lua_State *l = entry->state->_l;
+        lua_settop(l, 0);
+        lua_rawgeti(l, LUA_REGISTRYINDEX, entry->tables);
+        lua_pushnil(l);
+        while (lua_next(l, 1) != 0) {
+            _restore(l, 2);
+        }
+        detail::_push_globals(l);
+        lua_rawgeti(l, LUA_REGISTRYINDEX, entry->metatable);
+        lua_setmetatable(l, -2);
+        lua_settop(l, 0);
+    }
+
+    void _release(Entry *entry) {
+        _reset(entry);
+        std::lock_guard<std::mutex> lock{_mutex};
+        _idle.push_back(entry);
+    }
+
+public:
+    // Exclusive use of a State of the pool
+    class Lease {
+        friend class StatePool;
+    private:
+        StatePool *_pool;
+        Entry *_entry;
+
+        Lease(StatePool *pool, Entry *entry) : _pool(pool), _entry(entry) {}
+
+    public:
+        Lease(const Lease &) = delete;
+        Lease &operator=(const Lease &) = delete;
+        Lease(Lease &&other) : _pool(other._pool), _entry(other._entry) {
+            other._entry = nullptr;
+        }
+        ~Lease() {
+            if (_entry != nullptr) _pool->_release(_entry);
+        }
+
+        State &operator*() const {
+            return *_entry->state;
+        }
+
+        State *operator->() const {
+            return _entry->state.get();
+        }
+    };
+
+    // Creates size States, each initialized by init
+    StatePool(std::size_t size, std::function<void(State &)> init,
+              bool should_open_libs = true)
+        : _init(init), _open_libs(should_open_libs) {
+        for (std::size_t i = 0; i < size; ++i) {
+            Entry *entry = _create();
+            _idle.push_back(entry);
+        }
+    }
+    StatePool(const StatePool &) = delete;
+    StatePool &operator=(const StatePool &) = delete;
+
+    // Leases an idle State. If there is none, a new one is created and
+    // added to the pool.
+    Lease Acquire() {
+        {
+            std::lock_guard<std::mutex> lock{_mutex};
+            if (!_idle.empty()) {
+                Entry *entry = _idle.back();
+                _idle.pop_back();
+                return Lease{this, entry};
+            }
+        }
+        return Lease{this, _create()};
+    }
+
+    // Number of States, leased or not
+    std::size_t Size() {
+        std::lock_guard<std::mutex> lock{_mutex};
+        return _entries.size();
+    }
+
+    std::size_t Idle() {
+        std::lock_guard<std::mutex> lock{_mutex};
+        return _idle.size();
+    }
+};
+}
@@ -0,0 +1,221 @@
+#pragma once
+
+#include "BoundSelector.h"
+#include "exotics.h"
+#include <iterator>
+#include "Key.h"
+#include "LuaRef.h"
+#include <string>
+
+namespace sel {
+/*
+ * Handle to a Lua table held in the registry. Lookups through a Table
+ * are raw (metamethods are ignored) and never walk a path, and the
+ * table can be iterated from C++.
+ *
+ * A Table made from a value that is not a table, such as a missing
+ * key, is invalid and converts to false: it is empty, reading from it
+ * gives nil and writing to it does nothing.
+ */
+class Table {
+private:
+    lua_State *_state;
+    LuaRef _ref;
+    bool _valid;
+
+    // Reads the key on top of the stack as a K without disturbing it
+    template <typename K>
+    static K _read_key(lua_State *l) {
+        // Converting the key in place can turn a number into a string
+        // and confuse lua_next
+        lua_pushvalue(l, -1);
+        return detail::_pop(detail::_id<K>{}, l);
+    }
+
+    static int _make_ref(lua_State *l, const int index) {
+        if (!lua_istable(l, index)) return LUA_NOREF;
+        lua_pushvalue(l, index);
+        return luaL_ref(l, LUA_REGISTRYINDEX);
+    }
+
+public:
+    // Takes a reference to the table at index
+    Table(lua_State *l, const int index)
+        : _state(l), _ref(l, _make_ref(l, index)),
+          _valid(lua_istable(l, index)) {}
+
+    explicit operator bool() const {
+        return _valid;
+    }
+
+    // A key/value pair reached through an iterator. Valid until the
+    // iterator is advanced.
+    class Entry {
+        friend class Table;
+    private:
+        lua_State *_state;
+        LuaRef _table;
+        LuaRef _key;
+
+        Entry(lua_State *l, LuaRef table, LuaRef key)
+            : _state(l), _table(table), _key(key) {}
+
+    public:
+        template <typename K>
+        K Key() const {
+            _key.Push(_state);
+            return detail::_pop(detail::_id<K>{}, _state);
+        }
+
+        template <typename V>
+        V Value() const {
+            _table.Push(_state);
+            _key.Push(_state);
+            lua_rawget(_state, -2);
+            V ret = detail::_get(detail::_id<V>{}, _state, -1);
+            lua_pop(_state, 2);
+            return ret;
+        }
+    };
+
+    // Input iterator over the pairs of the table in lua_next order.
+    // The current key is kept in a registry slot so the Lua stack is
+    // free to change between steps. Copies share that slot.
+    class iterator {
+        friend class Table;
+    private:
+        lua_State *_state;
+        LuaRef _table;
+        LuaRef _key;
+        bool _end;
+
+        iterator(lua_State *l, LuaRef table)
+            : _state(l), _table(table), _key(l, LUA_NOREF), _end(true) {}
+
+        // Moves to the key after the one on top of the stack, which is
+        // popped
+        void _next() {
+            _table.Push(_state);
+            lua_insert(_state, -2);
+            if (lua_next(_state, -2) == 0) {
+                _end = true;
+                lua_pop(_state, 1);
+                return;
+            }
+            lua_pop(_state, 1);
+            if (_end) {
+                _key = LuaRef{_state, luaL_ref(_state, LUA_REGISTRYINDEX)};
+                _end = false;
+            } else {
+                _key.Replace(_state);
+            }
+            lua_pop(_state, 1);
+        }
+
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = Entry;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Entry *;
+        using reference = Entry;
+
+        Entry operator*() const {
+            return Entry{_state, _table, _key};
+        }
+
+        iterator &operator++() {
+            _key.Push(_state);
+            _next();
+            return *this;
+        }
+
+        bool operator==(const iterator &other) const {
+            return _end == other._end && (_end || _key == other._key);
+        }
+
+        bool operator!=(const iterator &other) const {
+            return !(*this == other);
+        }
+    };
+
+    // Number of elements in the sequence part of the table
+    int Size() const {
+        if (!_valid) return 0;
+        _ref.Push(_state);
+        const int size = detail::_raw_len(_state, -1);
+        lua_pop(_state, 1);
+        return size;
+    }
+
+    BoundSelector operator[](const char *field) const {
+        return BoundSelector{_state, _ref, field, true};
+    }
+
+    BoundSelector operator[](const Key &key) const {
+        return BoundSelector{_state, _ref, key.Name().c_str(), true, key.Id()};
+    }
+
+    BoundSelector operator[](const int index) const {
+        return BoundSelector{_state, _ref, index, true};
+    }
+
+    iterator begin() const {
+        iterator it{_state, _ref};
+        if (!_valid) return it;
+        lua_pushnil(_state);
+        it._next();
+        return it;
+    }
+
+    iterator end() const {
+        return iterator{_state, _ref};
+    }
+
+    // Calls fun(key, value) for every pair with the key decoded as a K
+    // and the value as a V. The pair sits on the stack while fun runs
+    // so fun must leave the stack as it found it.
+    template <typename K, typename V, typename F>
+    void ForEach(F fun) const {
+        if (!_valid) return;
+        _ref.Push(_state);
+        const int table = lua_gettop(_state);
+        lua_pushnil(_state);
+        while (lua_next(_state, table) != 0) {
+            V value = detail::_get(detail::_id<V>{}, _state, -1);
+            lua_pop(_state, 1);
+            fun(_read_key<K>(_state), value);
+        }
+        lua_pop(_state, 1);
+    }
+
+    void Push(lua_State *state) const {
+        _ref.Push(state);
+    }
+};
+
+inline BoundSelector::operator Table() const {
+    _get();
+    Table ret{_state, -1};
+    lua_pop(_state, 1);
+    return ret;
+}
+
+namespace detail {
+inline Table _get(_id<Table>, lua_State *l, const int index) {
+    return Table{l, index};
+}
+
+inline Table _check_get(_id<Table>, lua_State *l, const int index) {
+    luaL_checktype(l, index, LUA_TTABLE);
+    return Table{l, index};
+}
+
+inline void _push(lua_State *l, Table table) {
+    table.Push(l);
+}
+
+inline void _push(lua_State *l, MetatableRegistry &, Table table) {
+    table.Push(l);
+}
+}
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "exotics.h"
+#include "Key.h"
+#include <vector>
+
+namespace sel {
+class Selector;
+
+/*
+ * Builds a table, including nested tables, directly on the Lua stack
+ * and assigns it in one go with Selector::operator=. Pass size hints
+ * wherever they are known so no table is rehashed while it grows.
+ *
+ * The table under construction sits on the stack, so other work with
+ * the same State must leave the stack as it found it until the
+ * builder is assigned or destroyed.
+ */
+class TableBuilder {
+    friend class Selector;
+private:
+    lua_State *_state;
+    // Absolute stack index of the outermost table
+    int _index;
+    // Next sequence index for Push, one entry per open table
+    std::vector<int> _next;
+
+    void _open(int narr, int nrec) {
+        lua_createtable(_state, narr, nrec);
+        _next.push_back(1);
+    }
+
+    // Sets the value on top of the stack as the field of the table
+    // beneath it
+    void _set_field(const char *key) {
+        lua_pushstring(_state, key);
+        lua_insert(_state, -2);
+        lua_rawset(_state, -3);
+    }
+
+    // Stores a new table under the given key of the current table and
+    // makes it the current table
+    void _begin_field(const char *key, int narr, int nrec) {
+        lua_createtable(_state, narr, nrec);
+        lua_pushstring(_state, key);
+        lua_pushvalue(_state, -2);
+        lua_rawset(_state, -4);
+        _next.push_back(1);
+    }
+
+    void _begin_index(int index, int narr, int nrec) {
+        lua_createtable(_state, narr, nrec);
+        lua_pushvalue(_state, -1);
+        lua_rawseti(_state, -3, index);
+        _next.push_back(1);
+    }
+
+    // Removes the table from the stack once it has been assigned
+    void _release() {
+        if (_state != nullptr) {
+            lua_settop(_state, _index - 1);
+            _state = nullptr;
+        }
+    }
+
+public:
+    TableBuilder(lua_State *l, int narr = 0, int nrec = 0)
+        : _state(l), _index(lua_gettop(l) + 1) {
+        _open(narr, nrec);
+    }
+    TableBuilder(const TableBuilder &) = delete;
+    TableBuilder &operator=(const TableBuilder &) = delete;
+    TableBuilder(TableBuilder &&other)
+        : _state(other._state), _index(other._index),
+          _next(std::move(other._next)) {
+        other._state = nullptr;
+    }
+    ~TableBuilder() {
+        _release();
+    }
+
+    // t[key] = value on the current table
+    template <typename V>
+    TableBuilder &Field(const char *key, const V &value) {
+        detail::_push(_state, value);
+        _set_field(key);
+        return *this;
+    }
+
+    template <typename V>
+    TableBuilder &Field(const Key &key, const V &value) {
+        key.Push(_state);
+        detail::_push(_state, value);
+        lua_rawset(_state, -3);
+        return *this;
+    }
+
+    // t[index] = value on the current table
+    template <typename V>
+    TableBuilder &Index(int index, const V &value) {
+        detail::_push(_state, value);
+        lua_rawseti(_state, -2, index);
+        return *this;
+    }
+
+    // Appends value to the sequence of the current table. Counts from
+    // 1 independently of Index.
+    template <typename V>
+    TableBuilder &Push(const V &value) {
+        detail::_push(_state, value);
+        lua_rawseti(_state, -2, _next.back()++);
+        return *this;
+    }
+
+    // Starts a nested table stored under key. Fields added until the
+    // matching End() go to the nested table.
+    TableBuilder &BeginField(const char *key, int narr = 0, int nrec = 0) {
+        _begin_field(key, narr, nrec);
+        return *this;
+    }
+
+    // Starts a nested table stored at index
+    TableBuilder &BeginIndex(int index, int narr = 0, int nrec = 0) {
+        _begin_index(index, narr, nrec);
+        return *this;
+    }
+
+    // Starts a nested table appended to the sequence
+    TableBuilder &BeginPush(int narr = 0, int nrec = 0) {
+        const int index = _next.back()++;
+        _begin_index(index, narr, nrec);
+        return *this;
+    }
+
+    // Closes the current nested table. Does nothing on the outermost
+    // table.
+    TableBuilder &End() {
+        if (_next.size() > 1) {
+            lua_pop(_state, 1);
+            _next.pop_back();
+        }
+        return *this;
+    }
+};
+}
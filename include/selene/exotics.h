@@ -1,6 +1,10 @@
 #pragma once
 
+#include <array>
 #include "function.h"
+#include <map>
+#include <unordered_map>
+#include <vector>
 
 /*
  * Extends manipulation of primitives on the stack with more exotic
@@ -28,5 +32,189 @@ inline void _push(lua_State *l, sel::function<R(Args...)> fun) {
     fun.Push(l);
 }
 
+/*
+ * Containers map to Lua tables. Sequences use the array part of the
+ * table and maps use arbitrary keys. Each conversion walks the table
+ * once with raw accesses and presizes the destination.
+ */
+
+inline int _abs_index(lua_State *l, const int index) {
+    return (index > 0 || index <= LUA_REGISTRYINDEX)
+        ? index : lua_gettop(l) + index + 1;
+}
+
+inline int _raw_len(lua_State *l, const int index) {
+#if LUA_VERSION_NUM >= 502
+    return static_cast<int>(lua_rawlen(l, index));
+#else
+    return static_cast<int>(lua_objlen(l, index));
+#endif
+}
+
+template <typename T>
+inline std::vector<T> _get(_id<std::vector<T>>, lua_State *l,
+                           const int index) {
+    std::vector<T> ret;
+    if (!lua_istable(l, index)) return ret;
+    const int table = _abs_index(l, index);
+    const int size = _raw_len(l, table);
+    ret.reserve(size);
+    for (int i = 1; i <= size; ++i) {
+        lua_rawgeti(l, table, i);
+        ret.push_back(_get(_id<T>{}, l, -1));
+        lua_pop(l, 1);
+    }
+    return ret;
+}
+
+// Elements missing from the table are value-initialized
+template <typename T, std::size_t N>
+inline std::array<T, N> _get(_id<std::array<T, N>>, lua_State *l,
+                             const int index) {
+    std::array<T, N> ret{};
+    if (!lua_istable(l, index)) return ret;
+    const int table = _abs_index(l, index);
+    const int size = _raw_len(l, table);
+    for (int i = 1; i <= size && i <= int(N); ++i) {
+        lua_rawgeti(l, table, i);
+        ret[i - 1] = _get(_id<T>{}, l, -1);
+        lua_pop(l, 1);
+    }
+    return ret;
+}
+
+template <typename M>
+inline M _get_map(lua_State *l, const int index) {
+    using K = typename M::key_type;
+    using V = typename M::mapped_type;
+    M ret;
+    if (!lua_istable(l, index)) return ret;
+    const int table = _abs_index(l, index);
+    lua_pushnil(l);
+    while (lua_next(l, table) != 0) {
+        // Convert a copy of the key. Converting the key in place can
+        // turn a number into a string and confuse lua_next.
+        lua_pushvalue(l, -2);
+        K key = _get(_id<K>{}, l, -1);
+        ret.emplace(std::move(key), _get(_id<V>{}, l, -2));
+        lua_pop(l, 2);
+    }
+    return ret;
+}
+
+template <typename K, typename V>
+inline std::map<K, V> _get(_id<std::map<K, V>>, lua_State *l,
+                           const int index) {
+    return _get_map<std::map<K, V>>(l, index);
+}
+
+template <typename K, typename V>
+inline std::unordered_map<K, V> _get(_id<std::unordered_map<K, V>>,
+                                     lua_State *l, const int index) {
+    return _get_map<std::unordered_map<K, V>>(l, index);
+}
+
+template <typename T>
+inline std::vector<T> _check_get(_id<std::vector<T>> id, lua_State *l,
+                                 const int index) {
+    luaL_checktype(l, index, LUA_TTABLE);
+    return _get(id, l, index);
+}
+
+template <typename T, std::size_t N>
+inline std::array<T, N> _check_get(_id<std::array<T, N>> id, lua_State *l,
+                                   const int index) {
+    luaL_checktype(l, index, LUA_TTABLE);
+    return _get(id, l, index);
+}
+
+template <typename K, typename V>
+inline std::map<K, V> _check_get(_id<std::map<K, V>> id, lua_State *l,
+                                 const int index) {
+    luaL_checktype(l, index, LUA_TTABLE);
+    return _get(id, l, index);
+}
+
+template <typename K, typename V>
+inline std::unordered_map<K, V> _check_get(_id<std::unordered_map<K, V>> id,
+                                           lua_State *l, const int index) {
+    luaL_checktype(l, index, LUA_TTABLE);
+    return _get(id, l, index);
+}
+
+// Declared ahead so nested containers find each other
+template <typename T>
+inline void _push(lua_State *l, const std::vector<T> &values);
+template <typename T, std::size_t N>
+inline void _push(lua_State *l, const std::array<T, N> &values);
+template <typename K, typename V>
+inline void _push(lua_State *l, const std::map<K, V> &values);
+template <typename K, typename V>
+inline void _push(lua_State *l, const std::unordered_map<K, V> &values);
+
+template <typename C>
+inline void _push_sequence(lua_State *l, const C &values) {
+    lua_createtable(l, static_cast<int>(values.size()), 0);
+    int i = 1;
+    for (const auto &value : values) {
+        _push(l, value);
+        lua_rawseti(l, -2, i++);
+    }
+}
+
+template <typename M>
+inline void _push_map(lua_State *l, const M &values) {
+    lua_createtable(l, 0, static_cast<int>(values.size()));
+    for (const auto &pair : values) {
+        _push(l, pair.first);
+        _push(l, pair.second);
+        lua_rawset(l, -3);
+    }
+}
+
+template <typename T>
+inline void _push(lua_State *l, const std::vector<T> &values) {
+    _push_sequence(l, values);
+}
+
+template <typename T, std::size_t N>
+inline void _push(lua_State *l, const std::array<T, N> &values) {
+    _push_sequence(l, values);
+}
+
+template <typename K, typename V>
+inline void _push(lua_State *l, const std::map<K, V> &values) {
+    _push_map(l, values);
+}
+
+template <typename K, typename V>
+inline void _push(lua_State *l, const std::unordered_map<K, V> &values) {
+    _push_map(l, values);
+}
+
+template <typename T>
+inline void _push(lua_State *l, MetatableRegistry &,
+                  const std::vector<T> &values) {
+    _push_sequence(l, values);
+}
+
+template <typename T, std::size_t N>
+inline void _push(lua_State *l, MetatableRegistry &,
+                  const std::array<T, N> &values) {
+    _push_sequence(l, values);
+}
+
+template <typename K, typename V>
+inline void _push(lua_State *l, MetatableRegistry &,
+                  const std::map<K, V> &values) {
+    _push_map(l, values);
+}
+
+template <typename K, typename V>
+inline void _push(lua_State *l, MetatableRegistry &,
+                  const std::unordered_map<K, V> &values) {
+    _push_map(l, values);
+}
+
 }
 }
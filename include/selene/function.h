@@ -1,5 +1,6 @@
 #pragma once
 
+#include "Budget.h"
 #include <functional>
 #include "LuaRef.h"
 #include <memory>
@@ -24,10 +25,9 @@ public:
         _ref.Push(_state);
         detail::_push_n(_state, args...);
         constexpr int num_args = sizeof...(Args);
-        lua_call(_state, num_args, 1);
-        R ret = detail::_pop(detail::_id<R>{}, _state);
-        lua_settop(_state, 0);
-        return ret;
+        detail::BudgetScope budget(_state);
+        budget.Call(num_args, 1);
+        return detail::_pop(detail::_id<R>{}, _state);
     }
 
     void Push(lua_State *state) {
@@ -47,8 +47,8 @@ public:
         _ref.Push(_state);
         detail::_push_n(_state, args...);
         constexpr int num_args = sizeof...(Args);
-        lua_call(_state, num_args, 1);
-        lua_settop(_state, 0);
+        detail::BudgetScope budget(_state);
+        budget.Call(num_args, 0);
     }
 
     void Push(lua_State *state) {
@@ -70,8 +70,9 @@ public:
         detail::_push_n(_state, args...);
         constexpr int num_args = sizeof...(Args);
         constexpr int num_ret = sizeof...(R);
-        lua_call(_state, num_args, num_ret);
-        return detail::_pop_n_reset<R...>(_state);
+        detail::BudgetScope budget(_state);
+        budget.Call(num_args, num_ret);
+        return detail::_pop_n<R...>(_state);
     }
 
     void Push(lua_State *state) {
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include "traits.h"
 #include "MetatableRegistry.h"
@@ -30,6 +31,14 @@ struct is_primitive<unsigned int> {
     static constexpr bool value = true;
 };
 template <>
+struct is_primitive<std::int64_t> {
+    static constexpr bool value = true;
+};
+template <>
+struct is_primitive<std::uint64_t> {
+    static constexpr bool value = true;
+};
+template <>
 struct is_primitive<bool> {
     static constexpr bool value = true;
 };
@@ -54,17 +63,30 @@ inline bool _get(_id<bool>, lua_State *l, const int index) {
 }
 
 inline int _get(_id<int>, lua_State *l, const int index) {
-    return lua_tointeger(l, index);
+    return static_cast<int>(lua_tointeger(l, index));
 }
 
 inline unsigned int _get(_id<unsigned int>, lua_State *l, const int index) {
-#if LUA_VERSION_NUM >= 502
+#if LUA_VERSION_NUM == 502
     return lua_tounsigned(l, index);
 #else
     return static_cast<unsigned>(lua_tointeger(l, index));
 #endif
 }
 
+// 64-bit integers go through lua_Integer, which has 64 bits from Lua
+// 5.3 on. Older versions store numbers as doubles, exact up to 2^53.
+// A uint64_t above INT64_MAX is seen as a negative integer in Lua and
+// converts back unchanged.
+inline std::int64_t _get(_id<std::int64_t>, lua_State *l, const int index) {
+    return static_cast<std::int64_t>(lua_tointeger(l, index));
+}
+
+inline std::uint64_t _get(_id<std::uint64_t>, lua_State *l,
+                          const int index) {
+    return static_cast<std::uint64_t>(lua_tointeger(l, index));
+}
+
 inline lua_Number _get(_id<lua_Number>, lua_State *l, const int index) {
     return lua_tonumber(l, index);
 }
@@ -88,17 +110,27 @@ inline T& _check_get(_id<T&>, lua_State *l, const int index) {
 };
 
 inline int _check_get(_id<int>, lua_State *l, const int index) {
-    return luaL_checkint(l, index);
+    return static_cast<int>(luaL_checkinteger(l, index));
 };
 
 inline unsigned int _check_get(_id<unsigned int>, lua_State *l, const int index) {
-#if LUA_VERSION_NUM >= 502
+#if LUA_VERSION_NUM == 502
     return luaL_checkunsigned(l, index);
 #else
-    return static_cast<unsigned>(luaL_checkint(l, index));
+    return static_cast<unsigned>(luaL_checkinteger(l, index));
 #endif
 }
 
+inline std::int64_t _check_get(_id<std::int64_t>, lua_State *l,
+                               const int index) {
+    return static_cast<std::int64_t>(luaL_checkinteger(l, index));
+}
+
+inline std::uint64_t _check_get(_id<std::uint64_t>, lua_State *l,
+                                const int index) {
+    return static_cast<std::uint64_t>(luaL_checkinteger(l, index));
+}
+
 inline lua_Number _check_get(_id<lua_Number>, lua_State *l, const int index) {
     return luaL_checknumber(l, index);
 }
@@ -120,15 +152,16 @@ template <std::size_t S, typename... Ts> // First template argument denotes
 struct _pop_n_impl {
     using type =  std::tuple<Ts...>;
 
+    // Reads the top S elements of the stack
     template <std::size_t... N>
     static type worker(lua_State *l,
                        _indices<N...>) {
-        return std::make_tuple(_get(_id<Ts>{}, l, N + 1)...);
+        return std::make_tuple(_get(_id<Ts>{}, l, int(N) - int(S))...);
     }
 
     static type apply(lua_State *l) {
         auto ret = worker(l, typename _indices_builder<S>::type());
-        lua_pop(l, S);
+        lua_pop(l, int(S));
         return ret;
     }
 };
@@ -156,48 +189,6 @@ typename _pop_n_impl<sizeof...(T), T...>::type _pop_n(lua_State *l) {
     return _pop_n_impl<sizeof...(T), T...>::apply(l);
 }
 
-template <std::size_t S, typename... Ts>
-struct _pop_n_reset_impl {
-    using type =  std::tuple<Ts...>;
-
-    template <std::size_t... N>
-    static type worker(lua_State *l,
-                       _indices<N...>) {
-        return std::make_tuple(_get(_id<Ts>{}, l, N + 1)...);
-    }
-
-    static type apply(lua_State *l) {
-        auto ret = worker(l, typename _indices_builder<S>::type());
-        lua_settop(l, 0);
-        return ret;
-    }
-};
-
-// Popping nothing returns void
-template <typename... Ts>
-struct _pop_n_reset_impl<0, Ts...> {
-    using type = void;
-    static type apply(lua_State *l) {
-        lua_settop(l, 0);
-    }
-};
-
-// Popping one element returns an unboxed value
-template <typename T>
-struct _pop_n_reset_impl<1, T> {
-    using type = T;
-    static type apply(lua_State *l) {
-        T ret = _get(_id<T>{}, l, -1);
-        lua_settop(l, 0);
-        return ret;
-    }
-};
-
-template <typename... T>
-typename _pop_n_reset_impl<sizeof...(T), T...>::type
-_pop_n_reset(lua_State *l) {
-    return _pop_n_reset_impl<sizeof...(T), T...>::apply(l);
-}
 
 template <typename T>
 T _pop(_id<T> t, lua_State *l) {
@@ -208,6 +199,30 @@ T _pop(_id<T> t, lua_State *l) {
 
 /* Setters */
 
+// luaL_setmetatable, which Lua 5.1 lacks
+inline void _set_metatable(lua_State *l, const char *name) {
+#if LUA_VERSION_NUM >= 502
+    luaL_setmetatable(l, name);
+#else
+    luaL_getmetatable(l, name);
+    lua_setmetatable(l, -2);
+#endif
+}
+
+// luaL_checkudata, also accepting the light userdata pushed for
+// pointers and references, which LuaJIT's version rejects
+inline void *_check_udata(lua_State *l, int index, const char *name) {
+#if LUA_VERSION_NUM < 502
+    if (lua_islightuserdata(l, index) && lua_getmetatable(l, index)) {
+        luaL_getmetatable(l, name);
+        const bool same = lua_rawequal(l, -1, -2) != 0;
+        lua_pop(l, 2);
+        if (same) return lua_touserdata(l, index);
+    }
+#endif
+    return luaL_checkudata(l, index, name);
+}
+
 inline void _push(lua_State *l) {}
 
 template <typename T>
@@ -218,7 +233,7 @@ inline void _push(lua_State *l, MetatableRegistry &m, T* t) {
 	else {
 		lua_pushlightuserdata(l, t);
 		if (const std::string* metatable = m.Find(typeid(T))) {
-			luaL_setmetatable(l, metatable->c_str());
+			_set_metatable(l, metatable->c_str());
 		}
 	}
 }
@@ -227,7 +242,7 @@ template <typename T>
 inline void _push(lua_State *l, MetatableRegistry &m, T& t) {
     lua_pushlightuserdata(l, &t);
     if (const std::string* metatable = m.Find(typeid(T))) {
-        luaL_setmetatable(l, metatable->c_str());
+        _set_metatable(l, metatable->c_str());
     }
 }
 
@@ -240,13 +255,21 @@ inline void _push(lua_State *l, MetatableRegistry &, int i) {
 }
 
 inline void _push(lua_State *l, MetatableRegistry &, unsigned int u) {
-#if LUA_VERSION_NUM >= 502
+#if LUA_VERSION_NUM == 502
     lua_pushunsigned(l, u);
 #else
-    lua_pushinteger(l, static_cast<int>(u));
+    lua_pushinteger(l, static_cast<lua_Integer>(u));
 #endif
 }
 
+inline void _push(lua_State *l, MetatableRegistry &, std::int64_t i) {
+    lua_pushinteger(l, static_cast<lua_Integer>(i));
+}
+
+inline void _push(lua_State *l, MetatableRegistry &, std::uint64_t u) {
+    lua_pushinteger(l, static_cast<lua_Integer>(u));
+}
+
 inline void _push(lua_State *l, MetatableRegistry &, lua_Number f) {
     lua_pushnumber(l, f);
 }
@@ -283,13 +306,21 @@ inline void _push(lua_State *l, int i) {
 }
 
 inline void _push(lua_State *l, unsigned int u) {
-#if LUA_VERSION_NUM >= 502
+#if LUA_VERSION_NUM == 502
     lua_pushunsigned(l, u);
 #else
-    lua_pushinteger(l, static_cast<int>(u));
+    lua_pushinteger(l, static_cast<lua_Integer>(u));
 #endif
 }
 
+inline void _push(lua_State *l, std::int64_t i) {
+    lua_pushinteger(l, static_cast<lua_Integer>(i));
+}
+
+inline void _push(lua_State *l, std::uint64_t u) {
+    lua_pushinteger(l, static_cast<lua_Integer>(u));
+}
+
 inline void _push(lua_State *l, lua_Number f) {
     lua_pushnumber(l, f);
 }
@@ -341,6 +372,17 @@ inline void _push_n(lua_State *l, T value, Rest... rest) {
     _push_n(l, rest...);
 }
 
+// Pushes values without copying them. Arguments bind as const
+// references to their decayed types so they select the same _push
+// overloads as the by-value _push_n above.
+inline void _push_refs(lua_State *) {}
+
+template <typename T, typename... Rest>
+inline void _push_refs(lua_State *l, const T &value, const Rest&... rest) {
+    _push(l, value);
+    _push_refs(l, rest...);
+}
+
 template <typename... T, std::size_t... N>
 inline void _push_dispatcher(lua_State *l,
                              const std::tuple<T...> &values,
@@ -32,6 +32,35 @@ inline std::ostream &operator<<(std::ostream &os, lua_State *l) {
     return os;
 }
 
+namespace detail {
+// Pushes the table of globals
+inline void _push_globals(lua_State *l) {
+#if LUA_VERSION_NUM >= 502
+    lua_rawgeti(l, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS);
+#else
+    lua_pushvalue(l, LUA_GLOBALSINDEX);
+#endif
+}
+
+// Restores the stack of l to the height it had on construction when it
+// goes out of scope. Operations that only push temporaries use this
+// instead of clearing the stack, so they are safe to run on top of the
+// arguments of a C++ function called from Lua.
+class ResetStackOnScopeExit {
+private:
+    lua_State *_stack;
+    int _saved_top;
+public:
+    explicit ResetStackOnScopeExit(lua_State *l)
+        : _stack(l), _saved_top(lua_gettop(l)) {}
+    ResetStackOnScopeExit(const ResetStackOnScopeExit &) = delete;
+    ResetStackOnScopeExit &operator=(const ResetStackOnScopeExit &) = delete;
+    ~ResetStackOnScopeExit() {
+        lua_settop(_stack, _saved_top);
+    }
+};
+}
+
 inline void _print() {
     std::cout << std::endl;
 }
@@ -1,10 +1,29 @@
+// Built twice: as test_runner, and with SELENE_BINDING_STATS defined as
+// test_runner_stats, which also runs the binding statistics tests.
+
 #include <algorithm>
+#include "allocator_tests.h"
+#include "async_tests.h"
+#include "benchmarks.h"
+#ifdef SELENE_BINDING_STATS
+#include "binding_stats_tests.h"
+#endif
+#include "budget_tests.h"
 #include "class_tests.h"
+#include "container_tests.h"
+#include "coroutine_tests.h"
+#include "gc_tests.h"
 #include "obj_tests.h"
+#include "pool_tests.h"
+#include "profiler_tests.h"
 #include "interop_tests.h"
+#include "load_tests.h"
 #include "metatable_tests.h"
+#include "query_tests.h"
 #include "reference_tests.h"
 #include "selector_tests.h"
+#include "table_tests.h"
+#include <cstring>
 #include <map>
 
 // A very simple testing framework
@@ -33,12 +52,34 @@ static TestMap tests = {
     {"test_pointer_return", test_pointer_return},
     {"test_reference_return", test_reference_return},
     {"test_nullptr_to_nil", test_nullptr_to_nil},
+    {"test_selector_in_for_each", test_selector_in_for_each},
+    {"test_selector_in_builder", test_selector_in_builder},
+    {"test_nested_callbacks", test_nested_callbacks},
+    {"test_function_in_callback", test_function_in_callback},
+    {"test_bind_free_function", test_bind_free_function},
+    {"test_bind_void_and_tuple", test_bind_void_and_tuple},
+    {"test_bind_checks_args", test_bind_checks_args},
 
     {"test_metatable_registry_ptr", test_metatable_registry_ptr},
     {"test_metatable_registry_ref", test_metatable_registry_ref},
     {"test_metatable_ptr_member", test_metatable_ptr_member},
     {"test_metatable_ref_member", test_metatable_ptr_member},
 
+    {"test_get_vector", test_get_vector},
+    {"test_set_vector", test_set_vector},
+    {"test_get_array", test_get_array},
+    {"test_map_round_trip", test_map_round_trip},
+    {"test_unordered_map_number_keys", test_unordered_map_number_keys},
+    {"test_nested_vector", test_nested_vector},
+    {"test_container_fun_args", test_container_fun_args},
+    {"test_pin_vector", test_pin_vector},
+
+    {"test_get_many", test_get_many},
+    {"test_query_shares_prefixes", test_query_shares_prefixes},
+    {"test_query_missing", test_query_missing},
+    {"test_query_parent_and_child", test_query_parent_and_child},
+    {"test_query_duplicate_paths", test_query_duplicate_paths},
+
     {"test_register_obj", test_register_obj},
     {"test_register_obj_member_variable", test_register_obj_member_variable},
     {"test_register_obj_to_table", test_register_obj_to_table},
@@ -60,6 +101,39 @@ static TestMap tests = {
     {"test_set_nested_index", test_set_nested_index},
     {"test_create_table_field", test_create_table_field},
     {"test_create_table_index", test_create_table_index},
+    {"test_pin_read", test_pin_read},
+    {"test_pin_write", test_pin_write},
+    {"test_pin_global", test_pin_global},
+    {"test_selector_no_alloc", test_selector_no_alloc},
+    {"test_select_deep_path", test_select_deep_path},
+    {"test_read_does_not_create_tables", test_read_does_not_create_tables},
+    {"test_read_traverses_once", test_read_traverses_once},
+    {"test_call", test_call},
+    {"test_call_nested_multi_return", test_call_nested_multi_return},
+    {"test_call_no_alloc", test_call_no_alloc},
+    {"test_pin_call", test_pin_call},
+    {"test_key_read_write", test_key_read_write},
+    {"test_key_metamethods", test_key_metamethods},
+    {"test_key_pin", test_key_pin},
+    {"test_key_pin_outlives_key", test_key_pin_outlives_key},
+    {"test_int64_round_trip", test_int64_round_trip},
+    {"test_uint64_round_trip", test_uint64_round_trip},
+
+    {"test_table_size", test_table_size},
+    {"test_table_raw_access", test_table_raw_access},
+    {"test_table_iterate", test_table_iterate},
+    {"test_table_iterate_empty", test_table_iterate_empty},
+    {"test_table_missing", test_table_missing},
+    {"test_table_for_each", test_table_for_each},
+    {"test_table_for_each_number_keys_as_strings",
+     test_table_for_each_number_keys_as_strings},
+    {"test_table_nested", test_table_nested},
+    {"test_table_fun_arg", test_table_fun_arg},
+    {"test_builder_fields", test_builder_fields},
+    {"test_builder_nested", test_builder_nested},
+    {"test_builder_index", test_builder_index},
+    {"test_builder_discarded", test_builder_discarded},
+    {"test_table_key", test_table_key},
 
     {"test_register_class", test_register_class},
     {"test_get_member_variable", test_get_member_variable},
@@ -77,7 +151,92 @@ static TestMap tests = {
     {"test_function_in_constructor", test_function_in_constructor},
     {"test_pass_function_to_lua", test_pass_function_to_lua},
     {"test_call_returned_lua_function", test_call_returned_lua_function},
-    {"test_call_multivalue_lua_function", test_call_multivalue_lua_function}
+    {"test_call_multivalue_lua_function", test_call_multivalue_lua_function},
+
+    {"test_custom_allocator", test_custom_allocator},
+    {"test_pool_allocator", test_pool_allocator},
+    {"test_pool_allocator_shrink", test_pool_allocator_shrink},
+    {"test_pool_allocator_move", test_pool_allocator_move},
+    {"test_memory_stats", test_memory_stats},
+    {"test_memory_limit", test_memory_limit},
+    {"test_memory_limit_pooled", test_memory_limit_pooled},
+    {"test_memory_stats_default", test_memory_stats_default},
+
+    {"test_gc_stop_restart", test_gc_stop_restart},
+    {"test_gc_step_for", test_gc_step_for},
+    {"test_gc_tuning", test_gc_tuning},
+    {"test_gc_generational", test_gc_generational},
+
+    {"test_pool_lease", test_pool_lease},
+    {"test_pool_reset_globals", test_pool_reset_globals},
+    {"test_pool_reset_tables", test_pool_reset_tables},
+    {"test_pool_reset_is_two_levels", test_pool_reset_is_two_levels},
+    {"test_pool_grows", test_pool_grows},
+
+    {"test_bytecode_cache", test_bytecode_cache},
+    {"test_bytecode_cache_invalidated", test_bytecode_cache_invalidated},
+    {"test_bytecode_cache_corrupt", test_bytecode_cache_corrupt},
+    {"test_bytecode_cache_mismatch", test_bytecode_cache_mismatch},
+    {"test_bytecode_cache_precompiled", test_bytecode_cache_precompiled},
+    {"test_bytecode_cache_errors", test_bytecode_cache_errors},
+    {"test_load_buffer", test_load_buffer},
+    {"test_load_mapped", test_load_mapped},
+    {"test_compile", test_compile},
+    {"test_compile_error_call", test_compile_error_call},
+    {"test_chunk_cache", test_chunk_cache},
+    {"test_open_lib", test_open_lib},
+
+    {"test_coroutine_resume", test_coroutine_resume},
+    {"test_coroutine_finish", test_coroutine_finish},
+    {"test_coroutine_error", test_coroutine_error},
+    {"test_coroutine_calls_cpp", test_coroutine_calls_cpp},
+    {"test_coroutine_pool", test_coroutine_pool},
+    {"test_coroutine_c_yield", test_coroutine_c_yield},
+
+    {"test_async_lookup", test_async_lookup},
+    {"test_async_other_thread", test_async_other_thread},
+    {"test_async_ready_and_errors", test_async_ready_and_errors},
+    {"test_async_yield", test_async_yield},
+
+    {"test_profiler_samples", test_profiler_samples},
+    {"test_profiler_stop", test_profiler_stop},
+    {"test_profiler_coroutine", test_profiler_coroutine},
+
+    {"test_budget_instructions", test_budget_instructions},
+    {"test_budget_time", test_budget_time},
+    {"test_budget_pcall", test_budget_pcall},
+    {"test_budget_selector", test_budget_selector},
+    {"test_budget_nested", test_budget_nested},
+    {"test_scoped_budget", test_scoped_budget},
+    {"test_budget_coroutine", test_budget_coroutine},
+
+#ifdef SELENE_BINDING_STATS
+    {"test_binding_stats_function", test_binding_stats_function},
+    {"test_binding_stats_class", test_binding_stats_class},
+    {"test_binding_stats_obj", test_binding_stats_obj},
+#endif
+};
+
+// Benchmarks share the Test signature and are run instead of the tests
+// with --benchmarks.
+static TestMap benchmarks = {
+    {"bench_read_depth", bench_read_depth},
+    {"bench_call", bench_call},
+    {"bench_bulk_vector", bench_bulk_vector},
+    {"bench_query", bench_query},
+    {"bench_builder", bench_builder},
+    {"bench_key", bench_key},
+    {"bench_allocators", bench_allocators},
+    {"bench_gc_step", bench_gc_step},
+    {"bench_state_pool", bench_state_pool},
+    {"bench_bytecode_cache", bench_bytecode_cache},
+    {"bench_load_mapped", bench_load_mapped},
+    {"bench_snippets", bench_snippets},
+    {"bench_coroutines", bench_coroutines},
+    {"bench_async", bench_async},
+    {"bench_profiler", bench_profiler},
+    {"bench_budget", bench_budget},
+    {"bench_bind", bench_bind}
 };
 
 // Executes all tests and returns the number of failures.
@@ -112,6 +271,23 @@ int ExecuteAll() {
     return num_tests - passing;
 }
 
+// Executes all benchmarks and returns the number of failures.
+int ExecuteBenchmarks() {
+    std::cout << "Running " << benchmarks.size() << " benchmarks..."
+              << std::endl;
+    int failures = 0;
+    for (auto it = benchmarks.begin(); it != benchmarks.end(); ++it) {
+        sel::State state{true};
+        std::cout << it->first << std::endl;
+        if (!it->second(state)) {
+            failures += 1;
+            std::cout << "Benchmark \"" << it->first << "\" failed."
+                      << std::endl;
+        }
+    }
+    return failures;
+}
+
 // Not used in general runs. For debugging purposes
 bool ExecuteTest(const char *test) {
     sel::State state{true};
@@ -124,7 +300,10 @@ bool ExecuteTest(const char *test) {
 }
 
 
-int main() {
+int main(int argc, char **argv) {
+    if (argc > 1 && std::strcmp(argv[1], "--benchmarks") == 0) {
+        return ExecuteBenchmarks();
+    }
     // Executing all tests will run all test cases and check leftover
     // stack size afterwards. It is expected that the stack size
     // post-test is 0.
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstring>
+#include <selene.h>
+#include <string>
+
+// Counts the calls it forwards to the C allocator
+struct CountingAllocator {
+    int &calls;
+    CountingAllocator(int &c) : calls(c) {}
+    void *Allocate(void *ptr, std::size_t osize, std::size_t nsize) {
+        ++calls;
+        return sel::DefaultAllocator{}.Allocate(ptr, osize, nsize);
+    }
+};
+
+bool test_custom_allocator(sel::State &) {
+    int calls = 0;
+    {
+        sel::State state{std::unique_ptr<CountingAllocator>(
+                new CountingAllocator{calls}), true};
+        state("x = {} for i = 1, 100 do x[i] = tostring(i) end");
+        if (!(state["x"][100] == "100")) return false;
+    }
+    return calls > 0;
+}
+
+bool test_pool_allocator(sel::State &) {
+    sel::State state{std::unique_ptr<sel::PoolAllocator>(
+            new sel::PoolAllocator), true};
+    state("t = {} for i = 1, 10000 do t[i] = {name = 'n' .. i, i} end "
+          "for i = 1, 10000, 2 do t[i] = nil end "
+          "collectgarbage() "
+          "big = string.rep('x', 100000) "
+          "s = 0 for i = 2, 10000, 2 do s = s + t[i][1] end");
+    return state["s"] == 25005000 && state["t"][10]["name"] == "n10" &&
+        state.Size() == 0;
+}
+
+bool test_pool_allocator_shrink(sel::State &) {
+    sel::PoolAllocator pool;
+    char *block = static_cast<char *>(pool.Allocate(nullptr, 0, 1000));
+    std::memset(block, 'x', 1000);
+    // From the C allocator to a small block, then to a smaller class
+    block = static_cast<char *>(pool.Allocate(block, 1000, 100));
+    const bool small = block != nullptr && block[99] == 'x';
+    char *const medium = block;
+    block = static_cast<char *>(pool.Allocate(block, 100, 20));
+    const bool smaller = block != nullptr && block[19] == 'x';
+    // The block left by the second shrink is reused for its class
+    char *other = static_cast<char *>(pool.Allocate(nullptr, 0, 100));
+    const bool reused = other == medium;
+    pool.Allocate(other, 100, 0);
+    return small && smaller && reused &&
+        pool.Allocate(block, 20, 0) == nullptr;
+}
+
+bool test_pool_allocator_move(sel::State &) {
+    sel::State state{std::unique_ptr<sel::PoolAllocator>(
+            new sel::PoolAllocator), true};
+    state("x = 'moved'");
+    sel::State other{std::move(state)};
+    sel::State assigned{true};
+    assigned = std::move(other);
+    assigned("y = x .. '!'");
+    return assigned["y"] == "moved!";
+}
+
+bool test_memory_stats(sel::State &) {
+    sel::State state{std::unique_ptr<sel::AccountingAllocator<>>(
+            new sel::AccountingAllocator<>), true};
+    const sel::MemoryStats before = state.MemoryStats();
+    state("t = {} for i = 1, 10000 do t[i] = {i} end");
+    const sel::MemoryStats during = state.MemoryStats();
+    state("t = nil collectgarbage()");
+    const sel::MemoryStats after = state.MemoryStats();
+    return before.live > 0 && during.live > before.live + 10000 * 16 &&
+        after.live < during.live && after.peak >= during.live &&
+        during.allocations > before.allocations + 10000 &&
+        after.failures == 0;
+}
+
+bool test_memory_limit(sel::State &) {
+    sel::State state{std::unique_ptr<sel::AccountingAllocator<>>(
+            new sel::AccountingAllocator<>), true};
+    if (!state.SetMemoryLimit(state.MemoryStats().live + 256 * 1024)) {
+        return false;
+    }
+    const bool failed = !state("big = string.rep('x', 1024 * 1024)");
+    const sel::MemoryStats stats = state.MemoryStats();
+    state("small = string.rep('y', 10)");
+    return failed && stats.failures > 0 && stats.live <= stats.limit &&
+        state["small"] == "yyyyyyyyyy" && state.Size() == 0;
+}
+
+bool test_memory_limit_pooled(sel::State &) {
+    using Allocator = sel::AccountingAllocator<sel::PoolAllocator>;
+    sel::State state{std::unique_ptr<Allocator>(new Allocator{4 * 1024 * 1024}),
+                     true};
+    const bool failed =
+        !state("local t = {} for i = 1, 1000000 do t[i] = {i} end");
+#if LUA_VERSION_NUM < 502
+    // No emergency collection frees the garbage of the failed call
+    state.ForceGC();
+#endif
+    state("x = 1");
+    return failed && state["x"] == 1 && state.MemoryStats().limit != 0;
+}
+
+bool test_memory_stats_default(sel::State &state) {
+    const sel::MemoryStats stats = state.MemoryStats();
+    return stats.live > 0 && stats.limit == 0 && !state.SetMemoryLimit(1);
+}
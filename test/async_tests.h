@@ -0,0 +1,107 @@
+#pragma once
+
+#include <chrono>
+#include <selene.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Stand-in for a backend: lookups complete when the test says so
+struct FakeService {
+    std::vector<std::pair<std::string, sel::Promise<int>>> pending;
+
+    sel::Future<int> Lookup(const std::string &key) {
+        sel::Promise<int> promise;
+        pending.emplace_back(key, promise);
+        return promise.GetFuture();
+    }
+
+    // Completes the pending lookups with the length of their key
+    void CompleteAll() {
+        auto done = std::move(pending);
+        pending.clear();
+        for (auto it = done.rbegin(); it != done.rend(); ++it) {
+            it->second.Set(int(it->first.size()));
+        }
+    }
+};
+
+bool test_async_lookup(sel::State &state) {
+    FakeService service;
+    state["lookup"] = [&service](std::string key) {
+        return service.Lookup(key);
+    };
+    state("results = {} "
+          "function handle(key) "
+          "  local a = lookup(key) "
+          "  local b = lookup(key .. key) "
+          "  results[key] = a + b "
+          "end");
+    sel::EventLoop loop{state};
+    loop.Spawn(state["handle"], "a");
+    loop.Spawn(state["handle"], "bc");
+    const bool waiting = loop.Tasks() == 2 && service.pending.size() == 2 &&
+        loop.RunOnce() == 0;
+    service.CompleteAll();
+    loop.RunOnce();
+    const bool second = service.pending.size() == 2;
+    service.CompleteAll();
+    loop.RunOnce();
+    return waiting && second && loop.Tasks() == 0 &&
+        state["results"]["a"] == 3 && state["results"]["bc"] == 6;
+}
+
+bool test_async_other_thread(sel::State &state) {
+    std::vector<sel::Promise<int>> promises;
+    state["fetch"] = [&promises](int) {
+        sel::Promise<int> promise;
+        promises.push_back(promise);
+        return promise.GetFuture();
+    };
+    state("total = 0 "
+          "function task(x) local v = fetch(x) total = total + v end");
+    sel::EventLoop loop{state};
+    for (int i = 1; i <= 10; ++i) {
+        loop.Spawn(state["task"], i);
+    }
+    std::thread backend{[&promises]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            for (std::size_t i = 0; i < promises.size(); ++i) {
+                promises[i].Set(int(i) + 1);
+            }
+        }};
+    loop.Run();
+    backend.join();
+    return state["total"] == 55 && loop.Errors().empty();
+}
+
+bool test_async_ready_and_errors(sel::State &state) {
+    state["ready"] = [](int x) {
+        sel::Promise<int> promise;
+        promise.Set(x * 2);
+        return promise.GetFuture();
+    };
+    state["never"] = []() {
+        return sel::Promise<int>{}.GetFuture();
+    };
+    // Outside a task a ready future is returned right away but a
+    // pending one is an error
+    const bool direct = state("x = ready(4)") && state["x"] == 8 &&
+        !state("never()");
+    sel::EventLoop loop{state};
+    state("function broken() error('bad task') end");
+    loop.Spawn(state["broken"]);
+    return direct && loop.Tasks() == 0 && loop.Errors().size() == 1 &&
+        loop.Errors()[0].find("bad task") != std::string::npos;
+}
+
+bool test_async_yield(sel::State &state) {
+    state("order = '' function task(name) "
+          "  for i = 1, 2 do order = order .. name coroutine.yield() end "
+          "end");
+    sel::EventLoop loop{state};
+    loop.Spawn(state["task"], "a");
+    loop.Spawn(state["task"], "b");
+    loop.Run();
+    return state["order"] == "abab";
+}
@@ -0,0 +1,477 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include "async_tests.h"
+#include "interop_tests.h"
+#include <sstream>
+#include "load_tests.h"
+#include <selene.h>
+
+// Benchmarks print their own measurements and return false only if
+// the work they timed produced a wrong result.
+
+// Runs fun the given number of times and returns the mean cost of a
+// call in nanoseconds
+template <typename F>
+double time_per_call(const int iterations, F fun) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        fun();
+    }
+    auto end = std::chrono::steady_clock::now();
+    std::chrono::duration<double, std::nano> elapsed = end - start;
+    return elapsed.count() / iterations;
+}
+
+int read_at_depth(const sel::Selector &selector, int depth) {
+    if (depth == 1) return selector["v"];
+    return read_at_depth(selector["n"], depth - 1);
+}
+
+bool bench_read_depth(sel::State &state) {
+    state("root = {} local t = root "
+          "for i = 1, 8 do t.v = i t.n = {} t = t.n end");
+    bool result = true;
+    for (int depth = 1; depth <= 8; depth *= 2) {
+        const double ns = time_per_call(20000, [&]() {
+                result = result && read_at_depth(state["root"], depth) == depth;
+            });
+        std::cout << "  depth " << depth + 1 << ": " << ns << " ns/read, "
+                  << ns / (depth + 1) << " ns/level" << std::endl;
+    }
+    return result;
+}
+
+bool bench_call(sel::State &state) {
+    state("function add(a, b) return a + b end");
+    bool result = true;
+    const double deferred = time_per_call(20000, [&]() {
+            const int sum = state["add"](1, 2);
+            result = result && sum == 3;
+        });
+    const double direct = time_per_call(20000, [&]() {
+            result = result && state["add"].Call<int>(1, 2) == 3;
+        });
+    auto pinned = state["add"].Pin();
+    const double bound = time_per_call(20000, [&]() {
+            result = result && pinned.Call<int>(1, 2) == 3;
+        });
+    std::cout << "  operator(): " << deferred << " ns/call" << std::endl
+              << "  Call: " << direct << " ns/call" << std::endl
+              << "  Pin().Call: " << bound << " ns/call" << std::endl;
+    return result;
+}
+
+bool bench_bulk_vector(sel::State &state) {
+    const int size = 100000;
+    std::vector<int> values(size);
+    for (int i = 0; i < size; ++i) values[i] = i;
+    bool result = true;
+    const double write = time_per_call(1, [&]() {
+            state["lookup"]["values"] = values;
+        });
+    const double read = time_per_call(1, [&]() {
+            std::vector<int> out = state["lookup"]["values"];
+            result = result && out == values;
+        });
+    const double per_element = time_per_call(1, [&]() {
+            std::vector<int> out;
+            out.reserve(size);
+            for (int i = 1; i <= size; ++i) {
+                out.push_back(int(state["lookup"]["values"][i]));
+            }
+            result = result && out == values;
+        });
+    std::cout << "  write " << size << " elements: " << write / 1e6
+              << " ms" << std::endl
+              << "  read " << size << " elements: " << read / 1e6
+              << " ms" << std::endl
+              << "  read " << size << " elements one by one: "
+              << per_element / 1e6 << " ms" << std::endl;
+    return result;
+}
+
+bool bench_query(sel::State &state) {
+    state("cfg = {net = {limits = {10, 20, 30}, timeout = 5, host = 'h'},"
+          "       log = {level = 2}}");
+    bool result = true;
+    const double separate = time_per_call(20000, [&]() {
+            const int a = state["cfg"]["net"]["limits"][1];
+            const int b = state["cfg"]["net"]["limits"][3];
+            const int c = state["cfg"]["net"]["timeout"];
+            const std::string d = state["cfg"]["net"]["host"];
+            const int e = state["cfg"]["log"]["level"];
+            result = result && a + b + c + e == 47 && d == "h";
+        });
+    const char *paths[] = {"cfg.net.limits.1", "cfg.net.limits.3",
+                           "cfg.net.timeout", "cfg.net.host",
+                           "cfg.log.level"};
+    sel::Query<int, int, int, std::string, int> query{
+        paths[0], paths[1], paths[2], paths[3], paths[4]};
+    const double batched = time_per_call(20000, [&]() {
+            auto r = state.GetMany(query);
+            result = result && std::get<0>(r) + std::get<1>(r) +
+                std::get<2>(r) + std::get<4>(r) == 47 && std::get<3>(r) == "h";
+        });
+    // One lookup per path segment when each key is read on its own
+    int lookups = 0;
+    for (const char *path : paths) {
+        lookups += 1 + int(std::count(path, path + std::strlen(path), '.'));
+    }
+    std::cout << "  separate: " << separate << " ns/tick, " << lookups
+              << " lookups/tick" << std::endl
+              << "  query: " << batched << " ns/tick, " << query.Lookups()
+              << " lookups/tick" << std::endl;
+    return result;
+}
+
+bool bench_builder(sel::State &state) {
+    const int fields = 200;
+    std::vector<std::string> names;
+    for (int i = 0; i < fields; ++i) names.push_back("f" + std::to_string(i));
+    const double per_leaf = time_per_call(200, [&]() {
+            state("ctx = nil");
+            for (int i = 0; i < fields; ++i) {
+                state["ctx"]["fields"][names[i].c_str()] = i;
+            }
+        });
+    bool result = state["ctx"]["fields"]["f199"] == 199;
+    const double built = time_per_call(200, [&]() {
+            auto builder = state.NewTable(0, 1);
+            builder.BeginField("fields", 0, fields);
+            for (int i = 0; i < fields; ++i) {
+                builder.Field(names[i].c_str(), i);
+            }
+            state["ctx"] = builder;
+        });
+    result = result && state["ctx"]["fields"]["f199"] == 199;
+    std::cout << "  operator= per field: " << per_leaf / 1e3
+              << " us/table of " << fields << std::endl
+              << "  TableBuilder: " << built / 1e3 << " us/table of "
+              << fields << std::endl;
+    return result;
+}
+
+bool bench_key(sel::State &state) {
+    state("frame = {entity = {position_x = 1}}");
+    const sel::Key entity = state.Intern("entity");
+    const sel::Key position_x = state.Intern("position_x");
+    bool result = true;
+    const double by_name = time_per_call(100000, [&]() {
+            result = result && state["frame"]["entity"]["position_x"] == 1;
+        });
+    const double by_key = time_per_call(100000, [&]() {
+            result = result && state["frame"][entity][position_x] == 1;
+        });
+    sel::Table table = state["frame"]["entity"];
+    const double table_name = time_per_call(100000, [&]() {
+            result = result && table["position_x"] == 1;
+        });
+    const double table_key = time_per_call(100000, [&]() {
+            result = result && table[position_x] == 1;
+        });
+    std::cout << "  Selector by name: " << by_name << " ns/read" << std::endl
+              << "  Selector by Key: " << by_key << " ns/read" << std::endl
+              << "  Table by name: " << table_name << " ns/read" << std::endl
+              << "  Table by Key: " << table_key << " ns/read" << std::endl;
+    return result;
+}
+
+// Runs a table and string heavy script in a fresh state
+template <typename Allocator>
+double time_script_with(const char *script, bool &result) {
+    return time_per_call(20, [&]() {
+            sel::State state{std::unique_ptr<Allocator>(new Allocator), true};
+            result = state(script) && result;
+        });
+}
+
+bool bench_allocators(sel::State &) {
+    const char *script =
+        "local t = {} "
+        "for i = 1, 20000 do "
+        "  t[i] = {id = i, name = 'item' .. i, tags = {'a', 'b'}} "
+        "end "
+        "local s = {} "
+        "for i = 1, 20000 do s[#s + 1] = t[i].name .. ':' .. i end "
+        "t = nil s = nil collectgarbage()";
+    bool result = true;
+    const double system = time_script_with<sel::DefaultAllocator>(script, result);
+    const double pooled = time_script_with<sel::PoolAllocator>(script, result);
+    std::cout << "  DefaultAllocator: " << system / 1e6 << " ms/run"
+              << std::endl
+              << "  PoolAllocator: " << pooled / 1e6 << " ms/run"
+              << std::endl;
+    return result;
+}
+
+// Compares the longest pause of a full collection with collecting the
+// same garbage in budgeted steps
+bool bench_gc_step(sel::State &state) {
+    // Some survivors among the garbage, as in a real heap: a run of
+    // dead objects with nothing alive after it is freed in one step
+    const char *garbage =
+        "keep = {} for i = 1, 200000 do local t = {i, tostring(i)} "
+        "if i % 100 == 0 then keep[#keep + 1] = t end end";
+    state.StopGC();
+    state(garbage);
+    const double full = time_per_call(1, [&]() { state.ForceGC(); });
+    // A full collection restarts the collector on Lua 5.1
+    state.StopGC();
+    state(garbage);
+    // Each call should end close to the budget; count those that
+    // overrun it by more than half
+    double longest = 0;
+    int steps = 0, overruns = 0;
+    bool finished = false;
+    while (!finished) {
+        const double step = time_per_call(1, [&]() {
+                finished = state.GCStepFor(std::chrono::microseconds(200));
+            });
+        longest = std::max(longest, step);
+        overruns += step > 300e3;
+        ++steps;
+    }
+    state.RestartGC();
+    std::cout << "  ForceGC: " << full / 1e3 << " us pause" << std::endl
+              << "  GCStepFor(200us): " << steps << " steps, " << overruns
+              << " over 300 us, longest " << longest / 1e3 << " us"
+              << std::endl;
+    return true;
+}
+
+void init_bench_state(sel::State &state) {
+    state("handlers = {} for i = 1, 200 do "
+          "  handlers['h' .. i] = function(x) return x + i end "
+          "end");
+    for (int i = 0; i < 100; ++i) {
+        state["bound"][i] = [](int x) { return x; };
+    }
+}
+
+bool bench_state_pool(sel::State &) {
+    bool result = true;
+    const double fresh = time_per_call(200, [&]() {
+            sel::State state{true};
+            init_bench_state(state);
+            result = state("request = handlers.h10(1)") && result;
+        });
+    sel::StatePool pool{1, init_bench_state};
+    const double pooled = time_per_call(200, [&]() {
+            auto lease = pool.Acquire();
+            result = (*lease)("request = handlers.h10(1)") && result;
+        });
+    std::cout << "  new State + init: " << fresh / 1e3 << " us/request"
+              << std::endl
+              << "  StatePool lease + reset: " << pooled / 1e3
+              << " us/request" << std::endl;
+    return result;
+}
+
+bool bench_bytecode_cache(sel::State &) {
+    TempDir scripts;
+    TempDir cache;
+    std::string source;
+    for (int i = 0; i < 2000; ++i) {
+        const std::string n = std::to_string(i);
+        source += "function f" + n + "(a, b)\n"
+            "  local t = {a, b, '" + n + "'}\n"
+            "  if a > b then return t[1] * " + n + " else return #t end\n"
+            "end\n";
+    }
+    const std::string path = scripts.Write("big.lua", source);
+    bool result = true;
+    const double plain = time_per_call(20, [&]() {
+            sel::State state;
+            result = state.Load(path) && result;
+        });
+    const double cached = time_per_call(20, [&]() {
+            sel::State state;
+            state.SetBytecodeCache(cache.Path());
+            result = state.Load(path) && result;
+        });
+    std::cout << "  Load: " << plain / 1e3 << " us/file" << std::endl
+              << "  Load with BytecodeCache: " << cached / 1e3
+              << " us/file" << std::endl;
+    return result;
+}
+
+bool bench_load_mapped(sel::State &) {
+    TempDir scripts;
+    std::string source = "data = {\n";
+    // LuaJIT limits a function to 2^16 constants of each kind
+    const int rows = LUA_VERSION_NUM >= 502 ? 200000 : 60000;
+    for (int i = 0; i < rows; ++i) {
+        source += "  {id = " + std::to_string(i) + ", name = \"item" +
+            std::to_string(i) + "\", weight = 1.5},\n";
+    }
+    source += "}\n";
+    const std::string path = scripts.Write("data.lua", source);
+    bool result = true;
+    const double load = time_per_call(5, [&]() {
+            sel::State state;
+            result = state.Load(path) && result;
+        });
+    const double copied = time_per_call(5, [&]() {
+            sel::State state;
+            std::ifstream file{path, std::ios::binary};
+            std::string code{std::istreambuf_iterator<char>{file},
+                             std::istreambuf_iterator<char>{}};
+            result = state(code.c_str()) && result;
+        });
+    const double mapped = time_per_call(5, [&]() {
+            sel::State state;
+            result = state.LoadMapped(path) && result;
+        });
+    std::cout << "  " << source.size() / (1024 * 1024) << " MiB script"
+              << std::endl
+              << "  Load: " << load / 1e6 << " ms" << std::endl
+              << "  read into string + operator(): " << copied / 1e6
+              << " ms" << std::endl
+              << "  LoadMapped: " << mapped / 1e6 << " ms" << std::endl;
+    return result;
+}
+
+bool bench_snippets(sel::State &state) {
+    state("request = {size = 10, user = 'u'}");
+    const char *rules[] = {
+        "result = request.size > 5 and request.user == 'u'",
+        "result = request.size * 2 < 100",
+        "result = #request.user == 1",
+    };
+    bool result = true;
+    const double parsed = time_per_call(30000, [&]() {
+            result = state(rules[0]) && state(rules[1]) && state(rules[2]) &&
+                result;
+        });
+    state.SetChunkCache(16);
+    const double cached = time_per_call(30000, [&]() {
+            result = state(rules[0]) && state(rules[1]) && state(rules[2]) &&
+                result;
+        });
+    sel::Chunk chunks[] = {state.Compile(rules[0]), state.Compile(rules[1]),
+                           state.Compile(rules[2])};
+    const double compiled = time_per_call(30000, [&]() {
+            result = chunks[0]() && chunks[1]() && chunks[2]() && result;
+        });
+    std::cout << "  operator(): " << parsed / 3 << " ns/snippet" << std::endl
+              << "  operator() with ChunkCache: " << cached / 3
+              << " ns/snippet" << std::endl
+              << "  Compile: " << compiled / 3 << " ns/snippet" << std::endl;
+    return result && state["result"] == true;
+}
+
+bool bench_coroutines(sel::State &state) {
+    state("function task(x) while true do x = coroutine.yield(x + 1) end end "
+          "function quick(x) return x end");
+    bool result = true;
+    const double spawn = time_per_call(20000, [&]() {
+            sel::Coroutine co = state.NewCoroutine(state["quick"]);
+            result = co.Resume<int>(1) == 1 && result;
+        });
+    sel::Coroutine co = state.NewCoroutine(state["task"]);
+    co.Resume<int>(0);
+    const double resume = time_per_call(100000, [&]() {
+            result = co.Resume<int>(1) == 2 && result;
+        });
+    std::cout << "  NewCoroutine + Resume + release: " << spawn
+              << " ns/task, " << state.GetCoroutinePool()->Created()
+              << " threads created" << std::endl
+              << "  Resume: " << resume << " ns/resume" << std::endl;
+    return result;
+}
+
+bool bench_async(sel::State &state) {
+    FakeService service;
+    state["lookup"] = [&service](std::string key) {
+        return service.Lookup(key);
+    };
+    state("count = 0 function handle(key) "
+          "  for i = 1, 4 do count = count + lookup(key) end "
+          "end");
+    const int tasks = 1000;
+    sel::EventLoop loop{state};
+    const double elapsed = time_per_call(1, [&]() {
+            for (int i = 0; i < tasks; ++i) {
+                loop.Spawn(state["handle"], "k");
+            }
+            while (loop.Tasks() > 0) {
+                service.CompleteAll();
+                loop.RunOnce();
+            }
+        });
+    std::cout << "  " << tasks << " tasks x 4 lookups: " << elapsed / 1e6
+              << " ms, " << elapsed / (tasks * 4) << " ns/await" << std::endl;
+    return int(state["count"]) > 0;
+}
+
+bool bench_profiler(sel::State &state) {
+    state("function fib(n) if n < 2 then return n end "
+          "return fib(n - 1) + fib(n - 2) end");
+    auto run = [&]() { state("fib(25)"); };
+    // Best of alternating rounds, the machine being noisy
+    double plain = 0, sampled = 0;
+    for (int round = 0; round < 5; ++round) {
+        const double p = time_per_call(5, run);
+        state.StartProfiler();
+        const double s = time_per_call(5, run);
+        state.StopProfiler();
+        plain = round == 0 ? p : std::min(plain, p);
+        sampled = round == 0 ? s : std::min(sampled, s);
+    }
+    const sel::Profiler &profiler = *state.GetProfiler();
+    std::ostringstream out;
+    profiler.Write(out);
+    std::cout << "  fib(25): " << plain / 1e6 << " ms, profiled every "
+              << profiler.Interval().count() << " us: " << sampled / 1e6
+              << " ms (" << (sampled / plain - 1) * 100 << "% overhead, "
+              << profiler.Samples() << " samples, "
+              << profiler.Stacks().size() << " stacks)" << std::endl;
+    return profiler.Samples() > 0 && !out.str().empty();
+}
+
+bool bench_budget(sel::State &state) {
+    state("function fib(n) if n < 2 then return n end "
+          "return fib(n - 1) + fib(n - 2) end");
+    auto run = [&]() { state("fib(25)"); };
+    double plain = 0, budgeted = 0;
+    for (int round = 0; round < 5; ++round) {
+        const double p = time_per_call(5, run);
+        state.SetBudget(sel::Budget{100000000, std::chrono::seconds(1)});
+        const double b = time_per_call(5, run);
+        state.SetBudget(sel::Budget{});
+        plain = round == 0 ? p : std::min(plain, p);
+        budgeted = round == 0 ? b : std::min(budgeted, b);
+    }
+    std::cout << "  fib(25): " << plain / 1e6 << " ms, with a budget: "
+              << budgeted / 1e6 << " ms ("
+              << (budgeted / plain - 1) * 100 << "% overhead)" << std::endl;
+    return state.LastOverrun() == sel::BudgetLimit::None;
+}
+
+bool bench_bind(sel::State &state) {
+    state["registered"] = &my_add;
+    state["bound"] = sel::bind<decltype(&my_add), &my_add>();
+    state("function loop(name, n) local f, s = _G[name], 0 "
+          "for i = 1, n do s = f(s, 1) end return s end");
+    const int n = 100000;
+    bool result = true;
+    auto run = [&](const char *name) {
+        return time_per_call(1, [&]() {
+                result = state["loop"].Call<int>(name, n) == n && result;
+            }) / n;
+    };
+    double registered = 0, bound = 0;
+    for (int round = 0; round < 5; ++round) {
+        const double r = run("registered");
+        const double b = run("bound");
+        registered = round == 0 ? r : std::min(registered, r);
+        bound = round == 0 ? b : std::min(bound, b);
+    }
+    std::cout << "  Registry: " << registered << " ns/call" << std::endl
+              << "  sel::bind: " << bound << " ns/call" << std::endl;
+    return result;
+}
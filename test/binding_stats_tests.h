@@ -0,0 +1,37 @@
+#pragma once
+
+#include <selene.h>
+#include <string>
+
+struct Counter {
+    int count = 0;
+    void Inc() { ++count; }
+};
+
+bool test_binding_stats_function(sel::State &state) {
+    state["add"] = [](int a, int b) { return a + b; };
+    state("for i = 1, 10 do add(i, i) end");
+    auto &stats = state.BindingStats().at("add");
+    std::uint64_t bucketed = 0;
+    for (auto n : stats.histogram) bucketed += n;
+    return stats.calls == 10 && bucketed == 10 &&
+        stats.total.count() > 0 && stats.Quantile(1.0) >= stats.Mean();
+}
+
+bool test_binding_stats_class(sel::State &state) {
+    state["Counter"].SetClass<Counter>("inc", &Counter::Inc);
+    state("c = Counter.new() c:inc() c:inc()");
+    auto &stats = state.BindingStats();
+    return stats.at("Counter.new").calls == 1 &&
+        stats.at("Counter.inc").calls == 2;
+}
+
+bool test_binding_stats_obj(sel::State &state) {
+    Counter counter;
+    state["counter"].SetObj(counter, "inc", &Counter::Inc);
+    state["util"]["twice"] = [](int x) { return 2 * x; };
+    state("counter.inc() counter.inc() util.twice(3)");
+    auto &stats = state.BindingStats();
+    return counter.count == 2 && stats.at("counter.inc").calls == 2 &&
+        stats.at("util.twice").calls == 1;
+}
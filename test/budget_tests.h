@@ -0,0 +1,101 @@
+#pragma once
+
+#include <chrono>
+#include <selene.h>
+#include <string>
+
+bool test_budget_instructions(sel::State &state) {
+    state.SetBudget(sel::Budget{100000});
+    const bool aborted = !state("while true do end");
+    const bool limit = state.LastOverrun() == sel::BudgetLimit::Instructions;
+    const bool usable = state("x = 0 for i = 1, 1000 do x = x + 1 end");
+    state.SetBudget(sel::Budget{});
+    return aborted && limit && usable && state["x"] == 1000 &&
+        state.LastOverrun() == sel::BudgetLimit::None;
+}
+
+bool test_budget_time(sel::State &state) {
+    using clock = std::chrono::steady_clock;
+    state.SetBudget(sel::Budget{0, std::chrono::milliseconds(20)});
+    const auto start = clock::now();
+    const bool aborted = !state("while true do end");
+    const auto elapsed = clock::now() - start;
+    return aborted && state.LastOverrun() == sel::BudgetLimit::Time &&
+        elapsed >= std::chrono::milliseconds(20) &&
+        elapsed < std::chrono::seconds(1);
+}
+
+bool test_budget_pcall(sel::State &state) {
+    state.SetBudget(sel::Budget{100000});
+    // The script cannot swallow the error
+    return !state("while true do pcall(function() while true do end end) "
+                  "end") &&
+        state.LastOverrun() == sel::BudgetLimit::Instructions;
+}
+
+bool test_budget_selector(sel::State &state) {
+    state("function spin() while true do end end "
+          "function add(a, b) return a + b end");
+    state.SetBudget(sel::Budget{100000});
+    bool call = false, deferred = false;
+    try {
+        state["spin"].Call<>();
+    } catch (sel::BudgetExceeded &e) {
+        call = e.Limit() == sel::BudgetLimit::Instructions &&
+            std::string{e.what()} == "instruction budget exceeded";
+    }
+    state("x = 1");
+    // Run by the destructor, which does not throw
+    state["spin"]();
+    deferred = state.LastOverrun() == sel::BudgetLimit::Instructions;
+    return call && deferred && state["add"](2, 3) == 5;
+}
+
+bool test_budget_nested(sel::State &state) {
+    struct Guard {
+        bool &released;
+        ~Guard() { released = true; }
+    };
+    bool released = false, nested = false;
+    state("function spin() while true do end end");
+    state["host"] = [&]() {
+        Guard guard{released};
+        try {
+            state["spin"].Call<>();
+        } catch (sel::BudgetExceeded &) {
+            nested = true;
+            throw;
+        }
+    };
+    state.SetBudget(sel::Budget{100000});
+    // The abort unwinds the C++ frames of host
+    const bool aborted = !state("host()");
+    return aborted && nested && released &&
+        state.LastOverrun() == sel::BudgetLimit::Instructions &&
+        state("x = 1");
+}
+
+bool test_scoped_budget(sel::State &state) {
+    state("function spin(n) for i = 1, n do end end");
+    state.SetBudget(sel::Budget{1000000});
+    bool aborted = false;
+    {
+        sel::ScopedBudget budget{state, sel::Budget{10000}};
+        try {
+            state["spin"].Call<>(100000);
+        } catch (sel::BudgetExceeded &) {
+            aborted = true;
+        }
+    }
+    state["spin"].Call<>(100000);
+    return aborted && state.GetBudget().instructions == 1000000;
+}
+
+bool test_budget_coroutine(sel::State &state) {
+    state("function spin() while true do end end");
+    state.SetBudget(sel::Budget{100000});
+    sel::Coroutine co = state.NewCoroutine(state["spin"]);
+    co.Resume<>();
+    return co.Status() == sel::CoroutineStatus::Error &&
+        co.Error().find("instruction budget exceeded") != std::string::npos;
+}
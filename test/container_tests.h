@@ -0,0 +1,59 @@
+#pragma once
+
+#include <selene.h>
+#include <string>
+
+bool test_get_vector(sel::State &state) {
+    state("arr = {1, 2, 3}");
+    std::vector<int> arr = state["arr"];
+    return arr == std::vector<int>{1, 2, 3};
+}
+
+bool test_set_vector(sel::State &state) {
+    state["t"]["arr"] = std::vector<std::string>{"a", "b", "c"};
+    state("joined = table.concat(t.arr) .. #t.arr");
+    return state["joined"] == "abc3";
+}
+
+bool test_get_array(sel::State &state) {
+    state("arr = {4, 5}");
+    std::array<int, 3> arr = state["arr"];
+    return arr[0] == 4 && arr[1] == 5 && arr[2] == 0;
+}
+
+bool test_map_round_trip(sel::State &state) {
+    std::map<std::string, int> in{{"a", 1}, {"b", 2}};
+    state["m"] = in;
+    state("m.c = 3");
+    std::map<std::string, int> out = state["m"];
+    return out.size() == 3 && out["a"] == 1 && out["c"] == 3;
+}
+
+bool test_unordered_map_number_keys(sel::State &state) {
+    state("m = {[10] = 'x', [20] = 'y'}");
+    std::unordered_map<int, std::string> m = state["m"];
+    return m.size() == 2 && m[10] == "x" && m[20] == "y";
+}
+
+bool test_nested_vector(sel::State &state) {
+    state["grid"] = std::vector<std::vector<int>>{{1, 2}, {3}};
+    state("total = grid[1][1] + grid[1][2] + grid[2][1]");
+    std::vector<std::vector<int>> grid = state["grid"];
+    return state["total"] == 6 && grid.size() == 2 && grid[1][0] == 3;
+}
+
+bool test_container_fun_args(sel::State &state) {
+    state["reverse"] = [](std::vector<int> values) {
+        return std::vector<int>(values.rbegin(), values.rend());
+    };
+    state("r = reverse({1, 2, 3})");
+    std::vector<int> r = state["r"];
+    return r == std::vector<int>{3, 2, 1};
+}
+
+bool test_pin_vector(sel::State &state) {
+    auto arr = state["t"]["arr"].Pin();
+    arr = std::vector<int>{7, 8};
+    std::vector<int> out = arr;
+    return out == std::vector<int>{7, 8};
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <selene.h>
+#include <string>
+#include <vector>
+
+bool test_coroutine_resume(sel::State &state) {
+    state("function counter(start, step) "
+          "  local n = start "
+          "  while true do step = coroutine.yield(n) or step n = n + step end "
+          "end");
+    sel::Coroutine co = state.NewCoroutine(state["counter"]);
+    const int a = co.Resume<int>(10, 1);
+    const int b = co.Resume<int>();
+    const int c = co.Resume<int>(5);
+    return a == 10 && b == 11 && c == 16 &&
+        co.Status() == sel::CoroutineStatus::Suspended;
+}
+
+bool test_coroutine_finish(sel::State &state) {
+    state("tasks = {} function tasks.run(name) "
+          "  local got = coroutine.yield(name .. ' started') "
+          "  return got * 2, 'done' "
+          "end");
+    sel::Coroutine co = state.NewCoroutine(state["tasks"]["run"]);
+    const std::string started = co.Resume<std::string>("job");
+    int value;
+    std::string done;
+    std::tie(value, done) = co.Resume<int, std::string>(21);
+    const sel::CoroutineStatus status = co.Status();
+    const int after = co.Resume<int>(1);
+    return started == "job started" && value == 42 && done == "done" &&
+        status == sel::CoroutineStatus::Finished && after == 0;
+}
+
+bool test_coroutine_error(sel::State &state) {
+    state("function fail() coroutine.yield() error('task failed') end");
+    sel::Coroutine co = state.NewCoroutine(state["fail"]);
+    co.Resume();
+    co.Resume();
+    return co.Status() == sel::CoroutineStatus::Error &&
+        co.Error().find("task failed") != std::string::npos;
+}
+
+bool test_coroutine_calls_cpp(sel::State &state) {
+    std::vector<int> seen;
+    state["record"] = [&seen](int x) { seen.push_back(x); };
+    state("function task() record(1) coroutine.yield() record(2) end");
+    sel::Coroutine co = state.NewCoroutine(state["task"]);
+    co.Resume();
+    const bool first = seen == std::vector<int>{1};
+    co.Resume();
+    return first && seen == std::vector<int>{1, 2};
+}
+
+bool test_coroutine_pool(sel::State &state) {
+    state("function quick(x) return x + 1 end "
+          "function slow() coroutine.yield() end");
+    for (int i = 0; i < 100; ++i) {
+        sel::Coroutine co = state.NewCoroutine(state["quick"]);
+        if (co.Resume<int>(i) != i + 1) return false;
+    }
+    {
+        // Suspended and unstarted threads are not shared
+        sel::Coroutine suspended = state.NewCoroutine(state["slow"]);
+        sel::Coroutine unstarted = state.NewCoroutine(state["slow"]);
+        suspended.Resume();
+    }
+    const sel::CoroutinePool *pool = state.GetCoroutinePool();
+    return pool->Created() == 2 && pool->Idle() == 1;
+}
+
+bool test_coroutine_c_yield(sel::State &state) {
+    // Yields 7 with its argument still below it on the stack
+    state["pause"] = sel::CFunction{[](lua_State *l) {
+            lua_pushinteger(l, 7);
+            return lua_yield(l, 1);
+        }};
+    state("function task() local x = pause('arg') return x * 2 end");
+    sel::Coroutine co = state.NewCoroutine(state["task"]);
+    const int yielded = co.Resume<int>();
+    const int returned = co.Resume<int>(5);
+    return yielded == 7 && returned == 10 &&
+        co.Status() == sel::CoroutineStatus::Finished;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <chrono>
+#include <selene.h>
+
+bool test_gc_stop_restart(sel::State &state) {
+    state.StopGC();
+    const std::size_t before = state.MemoryStats().live;
+    // Tables escaping to a global, which LuaJIT cannot sink
+    state("for i = 1, 20000 do t = {i} end");
+    const std::size_t stopped = state.MemoryStats().live;
+    state.RestartGC();
+    state.ForceGC();
+    return stopped > before + 20000 * 16 &&
+        state.MemoryStats().live < stopped;
+}
+
+bool test_gc_step_for(sel::State &state) {
+    state.StopGC();
+    state("for i = 1, 20000 do local t = {i} end");
+    const std::size_t garbage = state.MemoryStats().live;
+    bool finished = false;
+    for (int i = 0; i < 10000 && !finished; ++i) {
+        finished = state.GCStepFor(std::chrono::microseconds(100));
+    }
+    return finished && state.MemoryStats().live < garbage;
+}
+
+bool test_gc_tuning(sel::State &state) {
+    // Lua 5.4 keeps both in steps of 4 percent
+    state.SetGCPause(160);
+    state.SetGCStepMul(300);
+    const bool pause = state.SetGCPause(200) == 160;
+    const bool stepmul = state.SetGCStepMul(200) == 300;
+    return pause && stepmul && state.SetGCMode(sel::GCMode::Incremental);
+}
+
+bool test_gc_generational(sel::State &state) {
+    if (!state.SetGCMode(sel::GCMode::Generational)) {
+        return LUA_VERSION_NUM == 501 || LUA_VERSION_NUM == 503;
+    }
+    state("t = {} for i = 1, 10000 do t[i % 100] = {i} end");
+    state.GCStep();
+    state.SetGCMode(sel::GCMode::Incremental);
+    return state["t"][1][1] == 9901;
+}
@@ -175,3 +175,81 @@ bool test_nullptr_to_nil(sel::State &state) {
     state("result = x == nil");
     return static_cast<bool>(state["result"]);
 }
+
+bool test_selector_in_for_each(sel::State &state) {
+    state("t = {1, 2, 3}; scale = 10");
+    sel::Table t = state["t"];
+    int sum = 0;
+    t.ForEach<int, int>([&](int, int value) {
+            sum += value * int(state["scale"]);
+            state["last"] = value;
+        });
+    return sum == 60 && state["last"] == 3;
+}
+
+bool test_selector_in_builder(sel::State &state) {
+    state("x = 4; function inc(v) return v + 1 end");
+    state["t"] = state.NewTable()
+        .Field("a", int(state["x"]))
+        .Field("b", state["inc"].Call<int>(int(state["x"])));
+    return state["t"]["a"] == 4 && state["t"]["b"] == 5;
+}
+
+bool test_nested_callbacks(sel::State &state) {
+    state("function leaf(a) return a * 2 end");
+    state("function outer(a) return inner(a, a + 1) + 1 end");
+    state["inner"] = [&state](int a, int b) {
+        sel::function<int(int)> leaf = state["leaf"];
+        state["seen"] = a;
+        return leaf(a) + state["leaf"].Call<int>(b) + int(state["seen"]);
+    };
+    return state["outer"].Call<int>(3) == 6 + 8 + 3 + 1;
+}
+
+bool test_function_in_callback(sel::State &state) {
+    state("function twice(f, x) return f(x), f(x + 1) end");
+    state["apply"] = [](sel::function<int(int)> f, int x) {
+        return f(x) + f(x);
+    };
+    state("a, b = twice(function(x) return apply(function(y) return y end, x) end, 1)");
+    return state["a"] == 2 && state["b"] == 4;
+}
+
+int bound_calls = 0;
+
+void count_bound_call() {
+    ++bound_calls;
+}
+
+std::string repeat(std::string s, int n) {
+    std::string result;
+    for (int i = 0; i < n; ++i) result += s;
+    return result;
+}
+
+bool test_bind_free_function(sel::State &state) {
+    state["cadd"] = sel::bind<decltype(&my_add), &my_add>();
+    state["rep"] = sel::bind<decltype(&repeat), &repeat>();
+    state("x = cadd(4, 20) s = rep('ab', 3)");
+    return state["x"] == 24 && state["s"] == "ababab" &&
+        state["cadd"].Call<int>(1, 2) == 3;
+}
+
+bool test_bind_void_and_tuple(sel::State &state) {
+    state["t"] = state.NewTable();
+    auto count = state["t"]["count"].Pin();
+    count = sel::bind<decltype(&count_bound_call), &count_bound_call>();
+    state["sd"] = sel::bind<decltype(&my_sum_and_difference),
+                            &my_sum_and_difference>();
+    bound_calls = 0;
+    state("t.count() t.count() a, b = sd(5, 3)");
+    return bound_calls == 2 && state["a"] == 8 && state["b"] == 2;
+}
+
+bool test_bind_checks_args(sel::State &state) {
+    state["cadd"] = sel::bind<decltype(&my_add), &my_add>();
+    state("ok, err = pcall(cadd, 1, 'two')");
+    const std::string err = state["err"];
+    return state["ok"] == false &&
+        err.find("number expected") != std::string::npos;
+}
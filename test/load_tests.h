@@ -0,0 +1,193 @@
+#pragma once
+
+#include <cstdio>
+#include <dirent.h>
+#include <fstream>
+#include <selene.h>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Temporary directory removed with its files when going out of scope
+class TempDir {
+private:
+    std::string _path;
+public:
+    TempDir() {
+        char name[] = "/tmp/selene_test_XXXXXX";
+        _path = mkdtemp(name) != nullptr ? name : "";
+    }
+    ~TempDir() {
+        for (const std::string &file : Files()) {
+            std::remove(file.c_str());
+        }
+        rmdir(_path.c_str());
+    }
+    const std::string &Path() const {
+        return _path;
+    }
+    std::vector<std::string> Files() const {
+        std::vector<std::string> files;
+        DIR *dir = opendir(_path.c_str());
+        if (dir == nullptr) return files;
+        while (dirent *entry = readdir(dir)) {
+            const std::string name = entry->d_name;
+            if (name != "." && name != "..") files.push_back(_path + "/" + name);
+        }
+        closedir(dir);
+        return files;
+    }
+    std::string Write(const std::string &name, const std::string &contents) {
+        const std::string path = _path + "/" + name;
+        std::ofstream{path, std::ios::binary | std::ios::trunc} << contents;
+        return path;
+    }
+};
+
+bool test_bytecode_cache(sel::State &state) {
+    TempDir cache;
+    state.SetBytecodeCache(cache.Path());
+    const bool first = state.Load("../test/test.lua");
+    const std::size_t entries = cache.Files().size();
+    state("add = nil");
+    const bool second = state.Load("../test/test.lua");
+    const sel::BytecodeCache *stats = state.GetBytecodeCache();
+    return first && second && entries == 1 && stats->Misses() == 1 &&
+        stats->Hits() == 1 && state["add"].Call<int>(2, 3) == 5;
+}
+
+bool test_bytecode_cache_invalidated(sel::State &state) {
+    TempDir scripts;
+    TempDir cache;
+    state.SetBytecodeCache(cache.Path());
+    const std::string path = scripts.Write("s.lua", "#!/usr/bin/lua\nx = 1");
+    state.Load(path);
+    const int before = state["x"];
+    state.Load(scripts.Write("t.lua", "y = 1"));
+    scripts.Write("s.lua", "x = 2");
+    state.Load(path);
+    // The entry of the previous contents of s.lua is gone
+    return before == 1 && state["x"] == 2 &&
+        state.GetBytecodeCache()->Misses() == 3 &&
+        cache.Files().size() == 2;
+}
+
+bool test_bytecode_cache_corrupt(sel::State &state) {
+    TempDir scripts;
+    TempDir cache;
+    state.SetBytecodeCache(cache.Path());
+    const std::string path = scripts.Write("s.lua", "y = 3");
+    state.Load(path);
+    const std::string entry = cache.Files().at(0);
+    std::ofstream{entry, std::ios::binary | std::ios::trunc}
+        << LUA_SIGNATURE << "garbage";
+    state("y = nil");
+    const bool loaded = state.Load(path);
+    state("y = nil");
+    state.Load(path);
+    return loaded && state["y"] == 3 &&
+        state.GetBytecodeCache()->Misses() == 2 &&
+        state.GetBytecodeCache()->Hits() == 1;
+}
+
+bool test_bytecode_cache_mismatch(sel::State &state) {
+    TempDir scripts;
+    TempDir cache;
+    state.SetBytecodeCache(cache.Path());
+    const std::string path = scripts.Write("s.lua", "y = 3");
+    state.Load(path);
+    const std::string entry = cache.Files().at(0);
+    // The entry of another source under the name of this one
+    std::remove(entry.c_str());
+    state.Load(scripts.Write("t.lua", "y = 4"));
+    std::rename(cache.Files().at(0).c_str(), entry.c_str());
+    state("y = nil");
+    const bool loaded = state.Load(path);
+    return loaded && state["y"] == 3 &&
+        state.GetBytecodeCache()->Misses() == 3 &&
+        state.GetBytecodeCache()->Hits() == 0;
+}
+
+bool test_bytecode_cache_precompiled(sel::State &state) {
+    TempDir scripts;
+    TempDir cache;
+    const std::string path = scripts.Path() + "/p.luac";
+    state["path"] = path;
+    state("local f = io.open(path, 'wb') "
+          "f:write(string.dump(function() z = 5 end)) f:close()");
+    state.SetBytecodeCache(cache.Path());
+    return state.Load(path) && state["z"] == 5;
+}
+
+bool test_bytecode_cache_errors(sel::State &state) {
+    TempDir scripts;
+    TempDir cache;
+    state.SetBytecodeCache(cache.Path());
+    const std::string path = scripts.Write("bad.lua", "x = = 1");
+    return !state.Load(path) && !state.Load(scripts.Path() + "/none.lua") &&
+        cache.Files().empty();
+}
+
+bool test_load_buffer(sel::State &state) {
+    const char script[] = "x = 7 y = 8";
+    // Only the first statement is in the buffer
+    const bool loaded = state.LoadBuffer(script, 5, "=snippet");
+    const bool failed = !state.LoadBuffer("error('boom')", 13, "=snippet");
+    return loaded && failed && state["x"] == 7 && state.CheckNil("y");
+}
+
+bool test_load_mapped(sel::State &state) {
+    TempDir scripts;
+    const std::string path =
+        scripts.Write("m.lua", "#!/usr/bin/lua\nfunction line() "
+                      "return debug.getinfo(1, 'l').currentline end");
+    const std::string empty = scripts.Write("e.lua", "");
+    return state.LoadMapped(path) && state["line"].Call<int>() == 2 &&
+        state.LoadMapped(empty) &&
+        !state.LoadMapped(scripts.Path() + "/none.lua");
+}
+
+bool test_compile(sel::State &state) {
+    sel::Chunk increment = state.Compile("x = (x or 0) + 1");
+    sel::Chunk rule = state.Compile("return x > 2, 'checked'");
+    sel::Chunk broken = state.Compile("x = = 1");
+    increment();
+    increment();
+    increment();
+    bool passed;
+    std::string message;
+    std::tie(passed, message) = rule.Call<bool, std::string>();
+    return increment && state["x"] == 3 && passed && message == "checked" &&
+        !broken && !broken() && !broken.Error().empty();
+}
+
+bool test_compile_error_call(sel::State &state) {
+    sel::Chunk broken = state.Compile("syntax error(");
+    try {
+        broken.Call<int>();
+    } catch (std::runtime_error &e) {
+        return e.what() == broken.Error() && state.Size() == 0;
+    }
+    return false;
+}
+
+bool test_chunk_cache(sel::State &state) {
+    state.SetChunkCache(2);
+    state("x = 1");
+    state("x = x + 1");
+    state("x = x + 1");
+    state("y = 1");
+    state("z = 1");
+    state("x = 1");
+    const sel::ChunkCache *cache = state.GetChunkCache();
+    return state["x"] == 1 && cache->Hits() == 1 && cache->Misses() == 5 &&
+        cache->Size() == 2 && !state("x = = 1") && cache->Size() == 2;
+}
+
+bool test_open_lib(sel::State &) {
+    sel::State state;
+    state.OpenLib("string", luaopen_string);
+    return state.Size() == 0 && state("s = string.rep('a', 3)") &&
+        state["s"] == "aaa";
+}
@@ -0,0 +1,22 @@
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// Counts calls to the global operator new so tests can check that
+// selectors stay off the heap. Replacing it must happen in exactly one
+// translation unit of the test runner.
+std::size_t new_count = 0;
+
+void *operator new(std::size_t size) {
+    ++new_count;
+    void *ptr = std::malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr) throw std::bad_alloc{};
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+    // Routed through a pointer so the compiler does not pair this free
+    // with the new expressions it gets inlined into
+    static void (*volatile release)(void *) = std::free;
+    release(ptr);
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <selene.h>
+
+int pool_double(int x) {
+    return 2 * x;
+}
+
+void init_pool_state(sel::State &state) {
+    state["double"] = &pool_double;
+    state("limit = 10; config = {name = 'base'}");
+}
+
+bool test_pool_lease(sel::State &) {
+    sel::StatePool pool{2, init_pool_state};
+    auto lease = pool.Acquire();
+    return pool.Idle() == 1 && (*lease)["limit"] == 10 &&
+        (*lease)["double"].Call<int>(4) == 8;
+}
+
+bool test_pool_reset_globals(sel::State &) {
+    sel::StatePool pool{1, init_pool_state};
+    {
+        auto lease = pool.Acquire();
+        (*lease)("limit = 20; extra = 1; double = nil; "
+                 "setmetatable(_G, {__index = function() return 5 end})");
+    }
+    auto lease = pool.Acquire();
+    sel::State &state = *lease;
+    state("missing = undefined_global");
+    return state["limit"] == 10 && state["double"].Call<int>(3) == 6 &&
+        state.CheckNil("extra") && state.CheckNil("missing") &&
+        pool.Size() == 1;
+}
+
+bool test_pool_reset_tables(sel::State &) {
+    sel::StatePool pool{1, init_pool_state};
+    {
+        auto lease = pool.Acquire();
+        (*lease)("config.name = 'changed'; config.extra = 1; "
+                 "string.upper = string.lower; package.loaded.fake = {}");
+    }
+    auto lease = pool.Acquire();
+    sel::State &state = *lease;
+    state("upper = ('a'):upper(); fake = package.loaded.fake; "
+          "extra = config.extra");
+    return state["config"]["name"] == "base" && state["upper"] == "A" &&
+        state.CheckNil("fake") && state.CheckNil("extra");
+}
+
+bool test_pool_reset_is_two_levels(sel::State &) {
+    sel::StatePool pool{1, [](sel::State &state) {
+        state("config = {limits = {depth = 1}}");
+    }};
+    {
+        auto lease = pool.Acquire();
+        (*lease)("config.limits.depth = 2");
+    }
+    auto lease = pool.Acquire();
+    return (*lease)["config"]["limits"]["depth"] == 2;
+}
+
+bool test_pool_grows(sel::State &) {
+    sel::StatePool pool{1, init_pool_state};
+    auto first = pool.Acquire();
+    auto second = pool.Acquire();
+    (*first)("x = 1");
+    const bool separate = second->CheckNil("x");
+    auto moved = std::move(second);
+    return separate && pool.Size() == 2 && pool.Idle() == 0 &&
+        (*moved)["limit"] == 10;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <chrono>
+#include <selene.h>
+#include <sstream>
+#include <string>
+
+bool test_profiler_samples(sel::State &state) {
+    state("function spin(n) local x = 0 for i = 1, n do x = x + i end "
+          "return x end");
+    const sel::Profiler &profiler =
+        state.StartProfiler(std::chrono::microseconds(0));
+    state("spin(200000)");
+    state.StopProfiler();
+    std::ostringstream out;
+    profiler.Write(out);
+    const std::string collapsed = out.str();
+    return profiler.Samples() > 0 && !profiler.Running() &&
+        collapsed.find("main chunk (") == 0 &&
+        collapsed.find(";spin (") != std::string::npos &&
+        collapsed.back() == '\n';
+}
+
+bool test_profiler_stop(sel::State &state) {
+    state("function spin(n) local x = 0 for i = 1, n do x = x + i end "
+          "return x end");
+    state.StartProfiler(std::chrono::microseconds(0));
+    state("spin(10000)");
+    state.StopProfiler();
+    const std::size_t samples = state.GetProfiler()->Samples();
+    state("spin(10000)");
+    return samples > 0 && state.GetProfiler()->Samples() == samples &&
+        state["spin"](3) == 6;
+}
+
+bool test_profiler_coroutine(sel::State &state) {
+    state("function work(n) local x = 0 for i = 1, n do x = x + i end "
+          "return x end");
+    // Leaves an idle thread created before the profiler started
+    state.NewCoroutine(state["work"]).Resume<int>(1);
+    const sel::Profiler &profiler =
+        state.StartProfiler(std::chrono::microseconds(0));
+    sel::Coroutine co = state.NewCoroutine(state["work"]);
+    co.Resume<int>(100000);
+    state.StopProfiler();
+    // The coroutine's own stack, whose function has no name
+    for (auto &stack : profiler.Stacks()) {
+        if (stack.first.find("anonymous (") != 0) return false;
+    }
+    return profiler.Samples() > 0;
+}
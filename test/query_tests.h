@@ -0,0 +1,51 @@
+#pragma once
+
+#include <selene.h>
+#include <string>
+
+bool test_get_many(sel::State &state) {
+    state.Load("../test/test.lua");
+    int global;
+    std::string nested;
+    lua_Number key;
+    std::tie(global, nested, key) =
+        state.GetMany<int, std::string, lua_Number>(
+            "my_global", "my_table.nested.foo", "my_table.key");
+    return global == 4 && nested == "bar" && key == lua_Number(6.4);
+}
+
+bool test_query_shares_prefixes(sel::State &state) {
+    state.Load("../test/test.lua");
+    sel::Query<std::string, int, std::string> query{
+        "my_table.3", "my_table.nested.2", "my_table.nested.foo"};
+    auto result = state.GetMany(query);
+    // my_table, 3, nested, 2 and foo
+    return query.Lookups() == 5 &&
+        result == std::make_tuple(std::string{"hi"}, -3, std::string{"bar"});
+}
+
+bool test_query_missing(sel::State &state) {
+    state.Load("../test/test.lua");
+    sel::Query<int, int> query{"missing.a.b", "my_global"};
+    auto result = state.GetMany(query);
+    state("created = missing ~= nil");
+    return result == std::make_tuple(0, 4) && !state["created"];
+}
+
+bool test_query_parent_and_child(sel::State &state) {
+    state("t = {x = 3}");
+    sel::Query<sel::Table, int> query{"t", "t.x"};
+    sel::Table t = std::get<0>(state.GetMany(query));
+    return t["x"] == 3 && std::get<1>(state.GetMany(query)) == 3;
+}
+
+bool test_query_duplicate_paths(sel::State &state) {
+    state("t = {x = 3, [7] = 'seven', ['99999999999'] = 'big'}");
+    sel::Query<int, int, std::string, std::string> query{
+        "t.x", "t.x", "t.7", "t.99999999999"};
+    // A path repeated reads the same node; an index too large for an
+    // int is a field name
+    return query.Lookups() == 4 &&
+        state.GetMany(query) == std::make_tuple(
+            3, 3, std::string{"seven"}, std::string{"big"});
+}
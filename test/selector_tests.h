@@ -1,7 +1,12 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <selene.h>
 
+// Calls to the global operator new, counted in new_count.cpp
+extern std::size_t new_count;
+
 bool test_select_global(sel::State &state) {
     state.Load("../test/test.lua");
     int answer = state["my_global"];
@@ -82,3 +87,167 @@ bool test_create_table_index(sel::State &state) {
     state["new_table"][3] = 4;
     return state["new_table"][3] == 4;
 }
+
+bool test_pin_read(sel::State &state) {
+    state.Load("../test/test.lua");
+    auto foo = state["my_table"]["nested"]["foo"].Pin();
+    auto index = state["my_table"]["nested"][2].Pin();
+    return foo == "bar" && index == -3;
+}
+
+bool test_pin_write(sel::State &state) {
+    state.Load("../test/test.lua");
+    auto key = state["my_table"]["key"].Pin();
+    key = 2;
+    const bool check1 = state["my_table"]["key"] == 2;
+    state("my_table.key = 5");
+    const bool check2 = int(key) == 5;
+    return check1 && check2;
+}
+
+bool test_pin_global(sel::State &state) {
+    state.Load("../test/test.lua");
+    auto global = state["my_global"].Pin();
+    global = 7;
+    return state["my_global"] == 7 && global == 7;
+}
+
+bool test_selector_no_alloc(sel::State &state) {
+    state.Load("../test/test.lua");
+    const std::size_t before = new_count;
+    state["my_table"]["nested"][2] = 5;
+    auto nested = state["my_table"]["nested"];
+    nested["foo"] = "baz";
+    const bool check1 = nested[2] == 5;
+    const bool check2 = lua_Number(state["my_table"]["key"]) == 6.4;
+    return check1 && check2 && new_count == before;
+}
+
+bool test_select_deep_path(sel::State &state) {
+    state["a"]["b"]["c"]["d"]["e"]["f"]["g"]["h"]["i"][10] = 4;
+    state("x = a.b.c.d.e.f.g.h.i[10]");
+    return state["x"] == 4 &&
+        state["a"]["b"]["c"]["d"]["e"]["f"]["g"]["h"]["i"][10] == 4;
+}
+
+bool test_read_does_not_create_tables(sel::State &state) {
+    const int answer = state["missing"]["a"][3];
+    state("created = missing ~= nil");
+    return answer == 0 && !state["created"];
+}
+
+bool test_read_traverses_once(sel::State &state) {
+    // Every level is a proxy whose __index counts the lookups made
+    // through it
+    state("lookups = 0");
+    state("function level(n)"
+          "  if n == 0 then return 42 end"
+          "  return setmetatable({}, {__index = function(t, k)"
+          "    lookups = lookups + 1 return level(n - 1) end})"
+          "end");
+    state("proxy = level(5)");
+    const int answer = state["proxy"]["a"]["b"][1]["c"]["d"];
+    return answer == 42 && state["lookups"] == 5;
+}
+
+bool test_call(sel::State &state) {
+    state.Load("../test/test.lua");
+    state["foo"].Call();
+    const int sum = state["add"].Call<int>(5, 2);
+    int x;
+    bool y;
+    std::string z;
+    std::tie(x, y, z) = state["bar"].Call<int, bool, std::string>();
+    const bool check1 = sum == 7 && x == 4 && y && z == "hi";
+    const bool check2 = state["mytable"]["foo"].Call<int>() == 4;
+    state("function id(s) return s end");
+    const bool check3 = state["id"].Call<std::string>("hi") == "hi";
+    return check1 && check2 && check3;
+}
+
+bool test_call_nested_multi_return(sel::State &state) {
+    state("t = {f = function(a, b) return a + b, a - b end}");
+    auto result = state["t"]["f"].Call<int, int>(3, 1);
+    return result == std::make_tuple(4, 2);
+}
+
+bool test_call_no_alloc(sel::State &state) {
+    state.Load("../test/test.lua");
+    const std::string long_string(64, 'x');
+    state("function id(s) return s end");
+    auto add = state["add"];
+    const std::size_t before = new_count;
+    const int sum = add.Call<int>(5, 2);
+    state["id"].Call<bool>(long_string);
+    state["mytable"]["foo"].Call();
+    return sum == 7 && new_count == before;
+}
+
+bool test_pin_call(sel::State &state) {
+    state.Load("../test/test.lua");
+    auto foo = state["mytable"]["foo"].Pin();
+    auto sum_and_difference = state["sum_and_difference"].Pin();
+    return foo.Call<int>() == 4 &&
+        sum_and_difference.Call<int, int>(3, 1) == std::make_tuple(4, 2) &&
+        state.Size() == 0;
+}
+
+bool test_key_read_write(sel::State &state) {
+    state("frame = {position = 3}");
+    const sel::Key position = state.Intern("position");
+    const sel::Key velocity = state.Intern("velocity");
+    state["frame"][velocity] = 4;
+    state["made"]["on"][velocity] = 5;
+    return state["frame"][position] == 3 &&
+        state["frame"]["velocity"] == 4 &&
+        state["made"]["on"]["velocity"] == 5;
+}
+
+bool test_key_metamethods(sel::State &state) {
+    state("t = setmetatable({}, {__index = function(t, k) return k .. '!' end})");
+    const sel::Key name = state.Intern("name");
+    return state["t"][name] == "name!";
+}
+
+bool test_key_pin(sel::State &state) {
+    state("frame = {position = 3}");
+    const sel::Key position = state.Intern("position");
+    auto pinned = state["frame"][position].Pin();
+    pinned = 7;
+    return state["frame"]["position"] == 7 && int(pinned) == 7;
+}
+
+bool test_key_pin_outlives_key(sel::State &state) {
+    state("frame = {position = 3}");
+    auto pinned = state["frame"][state.Intern("position")].Pin();
+    // May take the registry slot the first key released
+    const sel::Key other = state.Intern("other");
+    pinned = 7;
+    state("n = 0 for _ in pairs(frame) do n = n + 1 end");
+    return state["frame"]["position"] == 7 && int(pinned) == 7 &&
+        state["n"] == 1 && other.Name() == "other";
+}
+
+bool test_int64_round_trip(sel::State &state) {
+    // Doubles hold integers exactly up to 2^53 only
+    const std::int64_t big = LUA_VERSION_NUM >= 503
+        ? INT64_MAX : (std::int64_t(1) << 53);
+    state["big"] = big;
+    state["neg"] = -big;
+    state["dec"] = [](std::int64_t i) { return i - 1; };
+    const std::int64_t dec = state["dec"](big);
+    return std::int64_t(state["big"]) == big &&
+        std::int64_t(state["neg"]) == -big && dec == big - 1 &&
+        std::int64_t(state["big"].Pin()) == big;
+}
+
+bool test_uint64_round_trip(sel::State &state) {
+    state["id"] = std::uint64_t(12345678901);
+    const bool id = std::uint64_t(state["id"]) == 12345678901u;
+    if (LUA_VERSION_NUM < 503) return id;
+    // Stored as the integer with the same bits
+    state["max"] = UINT64_MAX;
+    state("is_minus_one = max == -1 and math.type(max) == 'integer'");
+    return id && std::uint64_t(state["max"]) == UINT64_MAX &&
+        state["is_minus_one"];
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <selene.h>
+#include <string>
+
+bool test_table_size(sel::State &state) {
+    state("t = {1, 2, 3, x = 4}");
+    sel::Table t = state["t"];
+    return t.Size() == 3;
+}
+
+bool test_table_raw_access(sel::State &state) {
+    state("t = setmetatable({a = 1}, {__index = function() return 9 end})");
+    sel::Table t = state["t"];
+    t[2] = "two";
+    t["b"] = 3;
+    state("b = rawget(t, 'b')");
+    const int missing = t["missing"];
+    return t["a"] == 1 && t[2] == "two" && state["b"] == 3 && missing == 0;
+}
+
+bool test_table_iterate(sel::State &state) {
+    state("t = {a = 1, b = 2, c = 3}");
+    sel::Table t = state["t"];
+    std::string keys;
+    int sum = 0;
+    for (auto entry : t) {
+        keys += entry.Key<std::string>();
+        sum += entry.Value<int>();
+    }
+    std::sort(keys.begin(), keys.end());
+    return keys == "abc" && sum == 6;
+}
+
+bool test_table_iterate_empty(sel::State &state) {
+    state("t = {}");
+    sel::Table t = state["t"];
+    return t.begin() == t.end();
+}
+
+bool test_table_missing(sel::State &state) {
+    state("t = {inner = 1}");
+    sel::Table missing = state["nope"];
+    sel::Table number = state["t"]["inner"];
+    int calls = 0;
+    missing.ForEach<int, int>([&](int, int) { ++calls; });
+    missing["x"] = 5;
+    number[1] = 5;
+    return !missing && !number && calls == 0 && missing.Size() == 0 &&
+        number.Size() == 0 && missing.begin() == missing.end() &&
+        missing["x"] == 0 && state["t"]["inner"] == 1;
+}
+
+bool test_table_for_each(sel::State &state) {
+    state("t = {10, 20, 30}");
+    sel::Table t = state["t"];
+    int key_sum = 0;
+    int value_sum = 0;
+    t.ForEach<int, int>([&](int key, int value) {
+            key_sum += key;
+            value_sum += value;
+        });
+    return key_sum == 6 && value_sum == 60;
+}
+
+bool test_table_for_each_number_keys_as_strings(sel::State &state) {
+    state("t = {5, 6, 7}");
+    sel::Table t = state["t"];
+    int count = 0;
+    t.ForEach<std::string, int>([&](std::string key, int value) {
+            count += key == std::to_string(value - 4);
+        });
+    return count == 3;
+}
+
+bool test_table_nested(sel::State &state) {
+    state("t = {inner = {x = 5}}");
+    sel::Table t = state["t"];
+    sel::Table inner = t["inner"];
+    return inner["x"] == 5;
+}
+
+bool test_table_fun_arg(sel::State &state) {
+    state["count"] = [](sel::Table t) {
+        int count = 0;
+        for (auto it = t.begin(); it != t.end(); ++it) ++count;
+        return count;
+    };
+    state("n = count({1, 2, x = 3})");
+    return state["n"] == 3;
+}
+
+bool test_builder_fields(sel::State &state) {
+    auto builder = state.NewTable(0, 3);
+    builder.Field("name", "req").Field("id", 7).Field("ok", true);
+    state["ctx"] = builder;
+    return state["ctx"]["name"] == "req" && state["ctx"]["id"] == 7 &&
+        state["ctx"]["ok"] == true;
+}
+
+bool test_builder_nested(sel::State &state) {
+    state["a"]["b"] = state.NewTable(0, 2)
+        .Field("x", 1)
+        .BeginField("inner", 2, 1)
+            .Push(10).Push(20).Field("y", "z")
+        .End()
+        .BeginField("list", 2)
+            .BeginPush(0, 1).Field("v", 1).End()
+            .BeginPush(0, 1).Field("v", 2).End()
+        .End();
+    state("n = #a.b.inner; m = #a.b.list");
+    return state["a"]["b"]["x"] == 1 &&
+        state["a"]["b"]["inner"][2] == 20 &&
+        state["a"]["b"]["inner"]["y"] == "z" &&
+        state["a"]["b"]["list"][2]["v"] == 2 &&
+        state["n"] == 2 && state["m"] == 2 && state.Size() == 0;
+}
+
+bool test_builder_index(sel::State &state) {
+    state["t"] = state.NewTable(3)
+        .Index(3, "c").Push("a").Index(-1, 5)
+        .BeginIndex(10).Field("k", 1).End();
+    return state["t"][1] == "a" && state["t"][3] == "c" &&
+        state["t"][-1] == 5 && state["t"][10]["k"] == 1;
+}
+
+bool test_builder_discarded(sel::State &state) {
+    {
+        auto builder = state.NewTable();
+        builder.BeginField("open").Field("x", 1);
+    }
+    return state.Size() == 0;
+}
+
+bool test_table_key(sel::State &state) {
+    const sel::Key id = state.Intern("id");
+    state["t"] = state.NewTable(0, 1).Field(id, 9);
+    sel::Table t = state["t"];
+    t[state.Intern("other")] = 2;
+    return t[id] == 9 && state["t"]["other"] == 2;
+}